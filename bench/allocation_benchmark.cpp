@@ -0,0 +1,267 @@
+// STL modules
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// POSIX modules
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Library nlohmann::json
+#include <nlohmann/json.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Custom modules
+#include "config.hpp"
+#include "controller.hpp"
+#include "http_server.hpp"
+#include "listeners.hpp"
+#include "utility.hpp"
+using namespace kc;
+
+/* Namespace aliases and imports */
+using nlohmann::json;
+
+// Count of heap allocations made by the whole process
+static std::atomic<uint64_t> Allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    Allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    Allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+struct Scenario
+{
+    const char* name;
+    std::vector<std::string> requests;
+    bool reconnect = false;     // Whether every request is made on a new connection
+};
+
+/*
+*   The client uses plain blocking sockets and fixed buffers,
+*   so every allocation counted while it runs is made by the server.
+*/
+class Client
+{
+private:
+    int m_socket;
+    char m_buffer[16 * 1024];
+
+public:
+    Client(uint16_t port)
+        : m_socket(socket(AF_INET, SOCK_STREAM, 0))
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+            throw std::runtime_error("Couldn't connect to in-process server");
+
+        int noDelay = 1;
+        setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+
+    ~Client()
+    {
+        close(m_socket);
+    }
+
+    /// @brief Send request and receive its response
+    /// @param request Serialized request
+    /// @return Response status
+    int perform(const std::string& request)
+    {
+        if (send(m_socket, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size()))
+            throw std::runtime_error("Couldn't send request");
+
+        size_t received = 0;
+        while (true)
+        {
+            ssize_t bytes = recv(m_socket, m_buffer + received, sizeof(m_buffer) - received - 1, 0);
+            if (bytes <= 0)
+                throw std::runtime_error("Couldn't receive response");
+            received += bytes;
+            m_buffer[received] = '\0';
+
+            const char* headerEnd = std::strstr(m_buffer, "\r\n\r\n");
+            if (!headerEnd)
+                continue;
+            const char* contentLength = strcasestr(m_buffer, "Content-Length:");
+            size_t bodyLength = contentLength && contentLength < headerEnd ? std::strtoul(contentLength + 15, nullptr, 10) : 0;
+            if (received >= static_cast<size_t>(headerEnd + 4 - m_buffer) + bodyLength)
+                return std::atoi(m_buffer + 9);
+        }
+    }
+};
+
+/// @brief Serialize request
+/// @param method Request method
+/// @param target Request target
+/// @param body Request body
+/// @return Serialized request
+static std::string Request(const char* method, const char* target, const char* body = "")
+{
+    return fmt::format("{} {} HTTP/1.1\r\nHost: localhost\r\nContent-Length: {}\r\n\r\n{}", method, target, std::strlen(body), body);
+}
+
+int main(int argc, char** argv)
+{
+    uint16_t port = 8091;
+    int requests = 10'000;
+    std::string pipeline = ConfigConst::Defaults::HttpPipeline;
+    for (int index = 1; index + 1 < argc; index += 2)
+    {
+        std::string option = argv[index];
+        if (option == "--port")
+            port = static_cast<uint16_t>(std::stoi(argv[index + 1]));
+        else if (option == "--requests")
+            requests = std::stoi(argv[index + 1]);
+        else if (option == "--pipeline")
+            pipeline = argv[index + 1];
+    }
+
+    json configJson;
+    configJson[ConfigConst::Objects::LogLevel] = "off";
+    configJson[ConfigConst::Objects::HttpPort] = port;
+    configJson[ConfigConst::Objects::HttpThreads] = 1;
+    configJson[ConfigConst::Objects::HttpMaxRequests] = 1'000'000'000;
+    configJson[ConfigConst::Objects::HttpPipeline] = pipeline;
+    configJson[ConfigConst::Objects::I2CBackend] = "simulated";
+    configJson[ConfigConst::Objects::I2CPort] = "simulated";
+    configJson[ConfigConst::Objects::I2CSimulatedLatency] = 0;
+
+    Config::Pointer config = std::make_shared<Config>(configJson);
+    Utility::SetLogLevel(config->logLevel());
+    Controller::Pointer controller = std::make_shared<Controller>(config);
+    Listeners listeners(*config);
+    HttpServer server(config, controller, listeners);
+    std::thread serverThread([&server]() { server.start(); });
+
+    std::vector<Scenario> scenarios = {
+        { "GET /relays", { Request("GET", "/relays") } },
+        { "GET /relays?pretty=true", { Request("GET", "/relays?pretty=true") } },
+        { "GET /relays/<relay>", { Request("GET", "/relays/one"), Request("GET", "/relays/sixteen") } },
+        { "POST /relays/<relay>", { Request("POST", "/relays/one", R"({"enabled":true})"), Request("POST", "/relays/one", R"({"enabled":false})") } },
+        { "POST /relays", { Request("POST", "/relays", R"({"enabled": true})"), Request("POST", "/relays", R"({"enabled": false})") } },
+        { "mixed", { Request("GET", "/relays"), Request("POST", "/relays/two", R"({"enabled":true})"), Request("GET", "/relays"), Request("POST", "/relays/two", R"({"enabled":false})") } },
+        { "GET /relays, connection per request", { Request("GET", "/relays") }, true },
+    };
+
+    int exitCode = 0;
+    json resultJson;
+    try
+    {
+        std::optional<Client> client;
+        auto perform = [&client, port](const Scenario& scenario, int index)
+        {
+            if (scenario.reconnect || !client)
+                client.emplace(port);
+            return client->perform(scenario.requests[index % scenario.requests.size()]);
+        };
+
+        for (const Scenario& scenario : scenarios)
+        {
+            // Warm up pools, caches and buffers before counting
+            for (int index = 0; index < 1000; ++index)
+                perform(scenario, index);
+
+            uint64_t before = Allocations.load();
+            int failures = 0;
+            for (int index = 0; index < requests; ++index)
+                failures += perform(scenario, index) != 200;
+            uint64_t allocations = Allocations.load() - before;
+
+            json scenarioJson;
+            scenarioJson["requests"] = requests;
+            scenarioJson["failures"] = failures;
+            scenarioJson["allocations"] = allocations;
+            scenarioJson["allocations_per_request"] = static_cast<double>(allocations) / requests;
+            resultJson[scenario.name] = scenarioJson;
+            if (allocations != 0 || failures != 0)
+                exitCode = 1;
+        }
+    }
+    catch (const std::exception& error)
+    {
+        fmt::print("Error: {}\n", error.what());
+        exitCode = 1;
+    }
+
+    server.stop();
+    serverThread.join();
+    fmt::print("{}\n", resultJson.dump(4));
+    return exitCode;
+}
@@ -0,0 +1,369 @@
+// STL modules
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// POSIX modules
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Library nlohmann::json
+#include <nlohmann/json.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Custom modules
+#include "config.hpp"
+#include "control_server.hpp"
+#include "controller.hpp"
+#include "http_server.hpp"
+#include "listeners.hpp"
+#include "utility.hpp"
+using namespace kc;
+
+/* Namespace aliases and imports */
+using nlohmann::json;
+
+struct Options
+{
+    uint16_t httpPort = 8092;
+    uint16_t controlPort = 8093;
+    int requests = 20'000;
+    int latency = ConfigConst::Defaults::I2CSimulatedLatency;
+    std::string output;
+};
+
+/// @brief Parse commandline arguments
+/// @param argc Count of arguments
+/// @param argv Values of arguments
+/// @param options Options to parse into
+/// @return True if arguments were parsed successfully
+static bool ParseOptions(int argc, char** argv, Options& options)
+{
+    for (int index = 1; index < argc; ++index)
+    {
+        std::string option = argv[index];
+        if (index + 1 == argc)
+        {
+            fmt::print("Option \"{}\" is unknown or requires a value\n", option);
+            return false;
+        }
+
+        std::string value = argv[++index];
+        if (option == "--http-port")
+            options.httpPort = static_cast<uint16_t>(std::stoi(value));
+        else if (option == "--control-port")
+            options.controlPort = static_cast<uint16_t>(std::stoi(value));
+        else if (option == "--requests")
+            options.requests = std::stoi(value);
+        else if (option == "--latency")
+            options.latency = std::stoi(value);
+        else if (option == "--output")
+            options.output = value;
+        else
+        {
+            fmt::print("Unknown option: \"{}\"\n", option);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Show help message
+/// @param executableName Benchmark executable name
+static void ShowHelpMessage(const char* executableName)
+{
+    fmt::print(
+        "ControlBenchmark usage: {} [OPTIONS]\n"
+        "Available options:\n"
+        "    --http-port <port>\t\tHTTP port of in-process server [8092]\n"
+        "    --control-port <port>\tControl protocol port of in-process server [8093]\n"
+        "    --requests <count>\t\tRound trips measured per scenario [20000]\n"
+        "    --latency <us>\t\tSimulated I2C transaction latency of in-process server [{}]\n"
+        "    --output <file>\t\tWrite results JSON to file\n",
+        executableName, ConfigConst::Defaults::I2CSimulatedLatency
+    );
+}
+
+/// @brief Open socket connected to in-process server
+/// @param type Socket type
+/// @param port Server port
+/// @return Connected socket
+static int Connect(int type, uint16_t port)
+{
+    int descriptor = socket(AF_INET, type, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (descriptor == -1 || connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+        throw std::runtime_error(fmt::format("Couldn't connect to in-process server on port {}", port));
+
+    if (type == SOCK_STREAM)
+    {
+        int noDelay = 1;
+        setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    return descriptor;
+}
+
+/// @brief Receive exactly requested count of bytes
+/// @param descriptor Socket to receive from
+/// @param buffer Buffer to receive to
+/// @param size Count of bytes to receive
+static void ReceiveExactly(int descriptor, uint8_t* buffer, size_t size)
+{
+    for (size_t received = 0; received < size;)
+    {
+        ssize_t bytes = recv(descriptor, buffer + received, size - received, 0);
+        if (bytes <= 0)
+            throw std::runtime_error("Couldn't receive response");
+        received += bytes;
+    }
+}
+
+/*
+*   Every scenario performs strictly sequential round trips over a single connection,
+*   so measured latency is the full reaction time seen by a client, not queueing behind other requests.
+*/
+class HttpClient
+{
+private:
+    int m_socket;
+    char m_buffer[16 * 1024];
+
+public:
+    HttpClient(uint16_t port)
+        : m_socket(Connect(SOCK_STREAM, port))
+    {}
+
+    ~HttpClient()
+    {
+        close(m_socket);
+    }
+
+    /// @brief Send request and receive its response
+    /// @param request Serialized request
+    /// @return True if response status is 200
+    bool perform(const std::string& request)
+    {
+        if (send(m_socket, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size()))
+            throw std::runtime_error("Couldn't send request");
+
+        size_t received = 0;
+        while (true)
+        {
+            ssize_t bytes = recv(m_socket, m_buffer + received, sizeof(m_buffer) - received - 1, 0);
+            if (bytes <= 0)
+                throw std::runtime_error("Couldn't receive response");
+            received += bytes;
+            m_buffer[received] = '\0';
+
+            const char* headerEnd = std::strstr(m_buffer, "\r\n\r\n");
+            if (!headerEnd)
+                continue;
+            const char* contentLength = strcasestr(m_buffer, "Content-Length:");
+            size_t bodyLength = contentLength && contentLength < headerEnd ? std::strtoul(contentLength + 15, nullptr, 10) : 0;
+            if (received >= static_cast<size_t>(headerEnd + 4 - m_buffer) + bodyLength)
+                return std::atoi(m_buffer + 9) == 200;
+        }
+    }
+};
+
+class ControlClient
+{
+private:
+    int m_socket;
+    bool m_stream;
+    uint32_t m_sequence;
+
+public:
+    ControlClient(int type, uint16_t port)
+        : m_socket(Connect(type, port))
+        , m_stream(type == SOCK_STREAM)
+        , m_sequence(0)
+    {
+        if (!m_stream)
+        {
+            // A lost datagram is retransmitted instead of stalling the benchmark
+            timeval timeout = { 0, 100'000 };
+            setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
+    }
+
+    ~ControlClient()
+    {
+        close(m_socket);
+    }
+
+    /// @brief Send request and receive its acknowledgement
+    /// @param opcode Request opcode
+    /// @param mask Request mask
+    /// @param value Request value
+    /// @return True if request was acknowledged successfully
+    bool perform(ControlServer::Opcode opcode, uint16_t mask, uint16_t value)
+    {
+        uint8_t request[ControlServer::RequestSize];
+        uint8_t response[ControlServer::ResponseSize];
+        ControlServer::EncodeRequest({ ControlServer::Version, opcode, 0, 0, ++m_sequence, mask, value }, request);
+
+        while (true)
+        {
+            if (send(m_socket, request, sizeof(request), 0) != static_cast<ssize_t>(sizeof(request)))
+                throw std::runtime_error("Couldn't send request");
+
+            if (m_stream)
+                ReceiveExactly(m_socket, response, sizeof(response));
+            else
+            {
+                // Acknowledgements of earlier retransmissions are skipped by their sequence numbers
+                ssize_t bytes;
+                do
+                    bytes = recv(m_socket, response, sizeof(response), 0);
+                while (bytes == sizeof(response) && ControlServer::DecodeResponse(response).sequence != m_sequence);
+                if (bytes != sizeof(response))
+                    continue;
+            }
+
+            ControlServer::Response decoded = ControlServer::DecodeResponse(response);
+            return decoded.sequence == m_sequence && decoded.status == ControlServer::Status::Ok;
+        }
+    }
+};
+
+/// @brief Get latency percentile
+/// @param latencies Sorted latencies
+/// @param percentile Percentile to get, from 0 to 100
+/// @return Latency percentile
+static double Percentile(const std::vector<double>& latencies, double percentile)
+{
+    if (latencies.empty())
+        return 0;
+    size_t index = static_cast<size_t>(percentile / 100.0 * (latencies.size() - 1) + 0.5);
+    return latencies[std::min(index, latencies.size() - 1)];
+}
+
+/// @brief Measure round trips of a scenario
+/// @param requests Count of measured round trips
+/// @param roundTrip Function performing a single round trip of given index
+/// @return Scenario results
+static json Measure(int requests, const std::function<bool(int)>& roundTrip)
+{
+    for (int index = 0; index < 1000; ++index)
+        roundTrip(index);
+
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    int failures = 0;
+    for (int index = 0; index < requests; ++index)
+    {
+        auto start = std::chrono::steady_clock::now();
+        failures += !roundTrip(index);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    json resultJson;
+    resultJson["requests"] = requests;
+    resultJson["failures"] = failures;
+    resultJson["latency_us"]["p50"] = Percentile(latencies, 50.0);
+    resultJson["latency_us"]["p99"] = Percentile(latencies, 99.0);
+    resultJson["latency_us"]["p999"] = Percentile(latencies, 99.9);
+    resultJson["latency_us"]["max"] = latencies.empty() ? 0.0 : latencies.back();
+    return resultJson;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (argc == 2 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"))
+    {
+        ShowHelpMessage(argv[0]);
+        return 0;
+    }
+    if (!ParseOptions(argc, argv, options))
+        return 1;
+
+    json configJson;
+    configJson[ConfigConst::Objects::LogLevel] = "off";
+    configJson[ConfigConst::Objects::HttpPort] = options.httpPort;
+    configJson[ConfigConst::Objects::HttpThreads] = 1;
+    configJson[ConfigConst::Objects::HttpMaxRequests] = 1'000'000'000;
+    configJson[ConfigConst::Objects::ControlPort] = options.controlPort;
+    configJson[ConfigConst::Objects::I2CBackend] = "simulated";
+    configJson[ConfigConst::Objects::I2CPort] = "simulated";
+    configJson[ConfigConst::Objects::I2CSimulatedLatency] = options.latency;
+
+    Config::Pointer config = std::make_shared<Config>(configJson);
+    Utility::SetLogLevel(config->logLevel());
+    Controller::Pointer controller = std::make_shared<Controller>(config);
+    Listeners listeners(*config);
+    HttpServer server(config, controller, listeners);
+    std::thread serverThread([&server]() { server.start(); });
+
+    std::string getRequest = "GET /relays HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string postRequests[] = {
+        "POST /relays/one HTTP/1.1\r\nHost: localhost\r\nContent-Length: 16\r\n\r\n{\"enabled\":true}",
+        "POST /relays/one HTTP/1.1\r\nHost: localhost\r\nContent-Length: 17\r\n\r\n{\"enabled\":false}",
+    };
+
+    int exitCode = 0;
+    json resultJson;
+    resultJson["options"]["requests"] = options.requests;
+    resultJson["options"]["i2c_latency_us"] = options.latency;
+    try
+    {
+        HttpClient http(options.httpPort);
+        ControlClient tcp(SOCK_STREAM, options.controlPort);
+        ControlClient udp(SOCK_DGRAM, options.controlPort);
+
+        auto toggle = [](ControlClient& client, int index)
+        {
+            return client.perform(index % 2 ? ControlServer::Opcode::ClearBits : ControlServer::Opcode::SetBits, 1, 0);
+        };
+
+        resultJson["scenarios"]["http get"] = Measure(options.requests, [&](int) { return http.perform(getRequest); });
+        resultJson["scenarios"]["http toggle"] = Measure(options.requests, [&](int index) { return http.perform(postRequests[index % 2]); });
+        resultJson["scenarios"]["tcp get"] = Measure(options.requests, [&](int) { return tcp.perform(ControlServer::Opcode::GetMask, 0, 0); });
+        resultJson["scenarios"]["tcp toggle"] = Measure(options.requests, [&](int index) { return toggle(tcp, index); });
+        resultJson["scenarios"]["udp get"] = Measure(options.requests, [&](int) { return udp.perform(ControlServer::Opcode::GetMask, 0, 0); });
+        resultJson["scenarios"]["udp toggle"] = Measure(options.requests, [&](int index) { return toggle(udp, index); });
+
+        for (const json& scenarioJson : resultJson["scenarios"])
+        {
+            if (scenarioJson["failures"] != 0)
+                exitCode = 1;
+        }
+    }
+    catch (const std::exception& error)
+    {
+        fmt::print("Error: {}\n", error.what());
+        exitCode = 1;
+    }
+
+    server.stop();
+    serverThread.join();
+
+    fmt::print("{}\n", resultJson.dump(4));
+    if (!options.output.empty())
+    {
+        std::ofstream outputFile(options.output);
+        if (!outputFile)
+        {
+            fmt::print("Couldn't create output file \"{}\"\n", options.output);
+            return 1;
+        }
+        outputFile << resultJson.dump(4) << '\n';
+    }
+    return exitCode;
+}
@@ -0,0 +1,317 @@
+// STL modules
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Boost libraries
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/asio.hpp>
+
+// Library nlohmann::json
+#include <nlohmann/json.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Custom modules
+#include "config.hpp"
+#include "controller.hpp"
+#include "http_server.hpp"
+#include "listeners.hpp"
+#include "utility.hpp"
+using namespace kc;
+
+/* Namespace aliases and imports */
+using nlohmann::json;
+namespace beast = boost::beast;
+namespace asio = boost::asio;
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 8090;
+    bool external = false;
+    int threads = ConfigConst::Defaults::HttpThreads;
+    int connections = 8;
+    int duration = 10;
+    double postRatio = 0.1;
+    bool keepAlive = true;
+    int latency = ConfigConst::Defaults::I2CSimulatedLatency;
+    int flushWindow = ConfigConst::Defaults::I2CFlushWindow;
+    std::string pipeline = ConfigConst::Defaults::HttpPipeline;
+    std::string output;
+};
+
+struct ClientResult
+{
+    std::vector<uint32_t> latencies;
+    uint64_t errors = 0;
+    uint64_t connects = 0;
+};
+
+/// @brief Parse commandline arguments
+/// @param argc Count of arguments
+/// @param argv Values of arguments
+/// @param options Options to parse into
+/// @return True if arguments were parsed successfully
+static bool ParseOptions(int argc, char** argv, Options& options)
+{
+    for (int index = 1; index < argc; ++index)
+    {
+        std::string option = argv[index];
+        if (option == "--no-keep-alive")
+        {
+            options.keepAlive = false;
+            continue;
+        }
+
+        if (index + 1 == argc)
+        {
+            fmt::print("Option \"{}\" is unknown or requires a value\n", option);
+            return false;
+        }
+
+        std::string value = argv[++index];
+        if (option == "--target")
+        {
+            size_t colon = value.rfind(':');
+            options.host = value.substr(0, colon);
+            options.port = static_cast<uint16_t>(std::stoi(value.substr(colon + 1)));
+            options.external = true;
+        }
+        else if (option == "--port")
+            options.port = static_cast<uint16_t>(std::stoi(value));
+        else if (option == "--threads")
+            options.threads = std::stoi(value);
+        else if (option == "--connections")
+            options.connections = std::stoi(value);
+        else if (option == "--duration")
+            options.duration = std::stoi(value);
+        else if (option == "--post-ratio")
+            options.postRatio = std::stod(value);
+        else if (option == "--latency")
+            options.latency = std::stoi(value);
+        else if (option == "--flush-window")
+            options.flushWindow = std::stoi(value);
+        else if (option == "--pipeline")
+            options.pipeline = value;
+        else if (option == "--output")
+            options.output = value;
+        else
+        {
+            fmt::print("Unknown option: \"{}\"\n", option);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Show help message
+/// @param executableName Benchmark executable name
+static void ShowHelpMessage(const char* executableName)
+{
+    fmt::print(
+        "HttpBenchmark usage: {} [OPTIONS]\n"
+        "Available options:\n"
+        "    --target <host:port>\tBenchmark a running server instead of an in-process one\n"
+        "    --port <port>\t\tPort of in-process server [8090]\n"
+        "    --threads <count>\t\tHTTP worker threads of in-process server [{}]\n"
+        "    --latency <us>\t\tSimulated I2C transaction latency of in-process server [{}]\n"
+        "    --flush-window <us>\t\tI2C flush window of in-process server [{}]\n"
+        "    --pipeline <name>\t\tRequest pipeline of in-process server, \"callback\" or \"coroutine\" [{}]\n"
+        "    --connections <count>\tConcurrent client connections [8]\n"
+        "    --duration <seconds>\tBenchmark duration [10]\n"
+        "    --post-ratio <ratio>\tShare of POST requests in workload [0.1]\n"
+        "    --no-keep-alive\t\tOpen a new connection for every request\n"
+        "    --output <file>\t\tWrite results JSON to file\n",
+        executableName, ConfigConst::Defaults::HttpThreads,
+        ConfigConst::Defaults::I2CSimulatedLatency, ConfigConst::Defaults::I2CFlushWindow, ConfigConst::Defaults::HttpPipeline
+    );
+}
+
+/// @brief Run client until deadline
+/// @param options Benchmark options
+/// @param seed Workload random generator seed
+/// @param deadline Time to stop at
+/// @param result Client result to fill
+static void RunClient(const Options& options, unsigned seed, std::chrono::steady_clock::time_point deadline, ClientResult& result)
+{
+    asio::io_context context;
+    asio::ip::tcp::endpoint endpoint(asio::ip::make_address(options.host), options.port);
+    beast::tcp_stream stream(context);
+    beast::flat_buffer buffer;
+    bool connected = false;
+
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> kind(0.0, 1.0);
+    std::uniform_int_distribution<size_t> relay(0, ConfigConst::Defaults::BoardChannels * std::size(ConfigConst::Defaults::BoardAddresses) - 1);
+    result.latencies.reserve(1 << 20);
+
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        beast::http::request<beast::http::string_body> request;
+        request.version(11);
+        request.set(beast::http::field::host, options.host);
+        request.keep_alive(options.keepAlive);
+        if (kind(generator) < options.postRatio)
+        {
+            request.method(beast::http::verb::post);
+            request.target(fmt::format("/relays/{}", Config::DefaultRelayName(relay(generator))));
+            request.body() = kind(generator) < 0.5 ? R"({"enabled":true})" : R"({"enabled":false})";
+            request.prepare_payload();
+        }
+        else
+        {
+            request.method(beast::http::verb::get);
+            request.target("/relays");
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            if (!connected)
+            {
+                stream.connect(endpoint);
+                connected = true;
+                ++result.connects;
+            }
+
+            beast::http::write(stream, request);
+            beast::http::response<beast::http::string_body> response;
+            beast::http::read(stream, buffer, response);
+            if (response.result() != beast::http::status::ok)
+                ++result.errors;
+
+            if (!response.keep_alive())
+            {
+                beast::error_code error;
+                stream.socket().shutdown(asio::ip::tcp::socket::shutdown_both, error);
+                stream.close();
+                buffer.clear();
+                connected = false;
+            }
+        }
+        catch (const boost::system::system_error&)
+        {
+            ++result.errors;
+            stream.close();
+            buffer.clear();
+            connected = false;
+            continue;
+        }
+
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        result.latencies.push_back(static_cast<uint32_t>(latency.count()));
+    }
+}
+
+/// @brief Get latency percentile
+/// @param latencies Sorted latencies
+/// @param percentile Percentile to get, from 0 to 100
+/// @return Latency percentile
+static uint32_t Percentile(const std::vector<uint32_t>& latencies, double percentile)
+{
+    if (latencies.empty())
+        return 0;
+    size_t index = static_cast<size_t>(percentile / 100.0 * (latencies.size() - 1) + 0.5);
+    return latencies[std::min(index, latencies.size() - 1)];
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (argc == 2 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"))
+    {
+        ShowHelpMessage(argv[0]);
+        return 0;
+    }
+    if (!ParseOptions(argc, argv, options))
+        return 1;
+
+    std::unique_ptr<HttpServer> server;
+    std::thread serverThread;
+    if (!options.external)
+    {
+        json configJson;
+        configJson[ConfigConst::Objects::LogLevel] = "off";
+        configJson[ConfigConst::Objects::HttpPort] = options.port;
+        configJson[ConfigConst::Objects::HttpThreads] = options.threads;
+        configJson[ConfigConst::Objects::HttpMaxRequests] = 1'000'000'000;
+        configJson[ConfigConst::Objects::HttpPipeline] = options.pipeline;
+        configJson[ConfigConst::Objects::I2CBackend] = "simulated";
+        configJson[ConfigConst::Objects::I2CPort] = "simulated";
+        configJson[ConfigConst::Objects::I2CFlushWindow] = options.flushWindow;
+        configJson[ConfigConst::Objects::I2CSimulatedLatency] = options.latency;
+
+        Config::Pointer config = std::make_shared<Config>(configJson);
+        Utility::SetLogLevel(config->logLevel());
+        Controller::Pointer controller = std::make_shared<Controller>(config);
+        Listeners listeners(*config);
+        server = std::make_unique<HttpServer>(config, controller, listeners);
+        serverThread = std::thread([&server]() { server->start(); });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(options.duration);
+    std::vector<ClientResult> results(options.connections);
+    std::vector<std::thread> clients;
+    for (int index = 0; index < options.connections; ++index)
+        clients.emplace_back(RunClient, std::cref(options), index, deadline, std::ref(results[index]));
+    for (std::thread& client : clients)
+        client.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (server)
+    {
+        server->stop();
+        serverThread.join();
+    }
+
+    std::vector<uint32_t> latencies;
+    uint64_t errors = 0, connects = 0;
+    for (const ClientResult& result : results)
+    {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+        connects += result.connects;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    json resultJson;
+    resultJson["options"]["target"] = fmt::format("{}:{}", options.host, options.port);
+    resultJson["options"]["in_process"] = !options.external;
+    resultJson["options"]["threads"] = options.threads;
+    resultJson["options"]["connections"] = options.connections;
+    resultJson["options"]["duration_s"] = options.duration;
+    resultJson["options"]["post_ratio"] = options.postRatio;
+    resultJson["options"]["keep_alive"] = options.keepAlive;
+    resultJson["options"]["i2c_latency_us"] = options.latency;
+    resultJson["options"]["i2c_flush_window_us"] = options.flushWindow;
+    resultJson["options"]["pipeline"] = options.pipeline;
+    resultJson["requests"] = latencies.size();
+    resultJson["errors"] = errors;
+    resultJson["connects"] = connects;
+    resultJson["throughput_rps"] = latencies.size() / elapsed;
+    resultJson["latency_us"]["p50"] = Percentile(latencies, 50.0);
+    resultJson["latency_us"]["p99"] = Percentile(latencies, 99.0);
+    resultJson["latency_us"]["p999"] = Percentile(latencies, 99.9);
+    resultJson["latency_us"]["max"] = latencies.empty() ? 0 : latencies.back();
+
+    fmt::print("{}\n", resultJson.dump(4));
+    if (!options.output.empty())
+    {
+        std::ofstream outputFile(options.output);
+        if (!outputFile)
+        {
+            fmt::print("Couldn't create output file \"{}\"\n", options.output);
+            return 1;
+        }
+        outputFile << resultJson.dump(4) << '\n';
+    }
+    return 0;
+}
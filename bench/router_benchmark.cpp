@@ -0,0 +1,94 @@
+// STL modules
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <unordered_map>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Custom modules
+#include "config.hpp"
+#include "router.hpp"
+using namespace kc;
+
+// Count of lookups performed by each router benchmark case
+constexpr int Iterations = 1'000'000;
+
+// Count of lookups performed by each linear scan benchmark case, every one of them formats hundreds of resources
+constexpr int ScanIterations = 10'000;
+
+// Accumulates lookup results so that the compiler can't drop the lookups
+static volatile size_t Sink = 0;
+
+/// @brief Measure average cost of a single lookup
+/// @param name Benchmark case name
+/// @param iterations Count of lookups to perform
+/// @param lookup Lookup to measure
+template <typename Lookup>
+static void Measure(const char* name, int iterations, Lookup lookup)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int iteration = 0; iteration < iterations; ++iteration)
+        Sink = Sink + lookup();
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    fmt::print("{:<28} {:>10.1f} ns/request\n", name, elapsed.count() / iterations);
+}
+
+// Count of relays routed, as many as 32 16-channel boards have
+constexpr size_t Relays = 512;
+
+/// @brief Route resource the way HttpServer used to: by formatting every relay resource
+/// @param names Relays' unique names
+/// @param resource Requested resource
+/// @return Index of found relay or Relays if not found
+static size_t LinearScan(const std::vector<std::string>& names, std::string_view resource)
+{
+    for (size_t relay = 0; relay < names.size(); ++relay)
+    {
+        if (resource == fmt::format("/relays/{}", names[relay]))
+            return relay;
+    }
+    return Relays;
+}
+
+int main()
+{
+    std::vector<std::string> names;
+    std::unordered_map<std::string, size_t, std::hash<std::string>, std::equal_to<>> relays;
+    for (size_t relay = 0; relay < Relays; ++relay)
+    {
+        names.push_back(Config::DefaultRelayName(relay));
+        relays.emplace(names.back(), relay);
+    }
+
+    /*
+    *   Relays are served by a single wildcard route whose parameter is looked up by name, the way HttpServer does:
+    *   the cost doesn't depend on how many relays are configured.
+    */
+    Router<std::function<size_t(std::string_view)>> router;
+    router.add("/relays", beast::http::verb::get, [](std::string_view) { return Relays; });
+    router.add("/relays/*", beast::http::verb::get, [&relays](std::string_view name)
+    {
+        auto relay = relays.find(std::string(name));
+        return relay == relays.end() ? Relays : relay->second;
+    });
+
+    auto routed = [&router](std::string_view resource)
+    {
+        Router<std::function<size_t(std::string_view)>>::Match match = router.find(resource, beast::http::verb::get);
+        return match.handler ? (*match.handler)(match.parameter) : static_cast<size_t>(match.status);
+    };
+
+    std::string last = fmt::format("/relays/{}", names.back());
+    fmt::print("Routing cost per request with {} relays:\n", Relays);
+    Measure("router: /relays/one", Iterations, [&]() { return routed("/relays/one"); });
+    Measure("router: last relay", Iterations, [&]() { return routed(last); });
+    Measure("router: miss", Iterations, [&]() { return routed("/relays/unknown"); });
+    Measure("linear scan: /relays/one", ScanIterations, [&]() { return LinearScan(names, "/relays/one"); });
+    Measure("linear scan: last relay", ScanIterations, [&]() { return LinearScan(names, last); });
+    Measure("linear scan: miss", ScanIterations, [&]() { return LinearScan(names, "/relays/unknown"); });
+    return 0;
+}
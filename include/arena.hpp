@@ -0,0 +1,112 @@
+#pragma once
+
+// STL modules
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace kc {
+
+/*
+*   Bump allocator over a fixed buffer that is reset as a whole.
+*   Deallocation of arena memory is a no-op, requests that don't fit
+*   are served from the heap, so an undersized arena is only slower, never wrong.
+*/
+class Arena
+{
+private:
+    std::unique_ptr<std::byte[]> m_buffer;
+    size_t m_capacity;
+    size_t m_used;
+
+public:
+    /// @brief Initialize arena
+    /// @param capacity Arena buffer capacity in bytes
+    Arena(size_t capacity);
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    /// @brief Allocate memory
+    /// @param size Count of bytes to allocate
+    /// @param alignment Alignment of allocated memory
+    /// @throw std::bad_alloc if heap allocation fails
+    /// @return Allocated memory
+    void* allocate(size_t size, size_t alignment);
+
+    /// @brief Deallocate memory
+    /// @param pointer Memory to deallocate
+    /// @param size Count of allocated bytes
+    /// @param alignment Alignment of allocated memory
+    void deallocate(void* pointer, size_t size, size_t alignment);
+
+    /// @brief Make the whole arena available again, all memory allocated from it must be deallocated
+    void reset();
+};
+
+template <typename Type>
+class ArenaAllocator
+{
+public:
+    template <typename Other>
+    friend class ArenaAllocator;
+
+    using value_type = Type;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <typename Other>
+    struct rebind
+    {
+        using other = ArenaAllocator<Other>;
+    };
+
+private:
+    Arena* m_arena;
+
+public:
+    /// @brief Initialize allocator
+    /// @param arena Arena to allocate from
+    explicit ArenaAllocator(Arena& arena)
+        : m_arena(&arena)
+    {}
+
+    template <typename Other>
+    ArenaAllocator(const ArenaAllocator<Other>& other)
+        : m_arena(other.m_arena)
+    {}
+
+    /// @brief Allocate objects storage
+    /// @param count Count of objects
+    /// @return Allocated storage
+    Type* allocate(size_t count)
+    {
+        return static_cast<Type*>(m_arena->allocate(count * sizeof(Type), alignof(Type)));
+    }
+
+    /// @brief Deallocate objects storage
+    /// @param pointer Storage to deallocate
+    /// @param count Count of objects
+    void deallocate(Type* pointer, size_t count)
+    {
+        m_arena->deallocate(pointer, count * sizeof(Type), alignof(Type));
+    }
+
+    template <typename Other>
+    bool operator==(const ArenaAllocator<Other>& other) const
+    {
+        return m_arena == other.m_arena;
+    }
+
+    template <typename Other>
+    bool operator!=(const ArenaAllocator<Other>& other) const
+    {
+        return m_arena != other.m_arena;
+    }
+};
+
+} // namespace kc
@@ -3,8 +3,13 @@
 // STL modules
 #include <string>
 #include <memory>
+#include <chrono>
+#include <vector>
+#include <unordered_set>
 #include <fstream>
 #include <stdexcept>
+#include <atomic>
+#include <mutex>
 
 // Library nlohmann::json
 #include <nlohmann/json.hpp>
@@ -12,6 +17,13 @@
 // Library {fmt}
 #include <fmt/format.h>
 
+// Library spdlog
+#include <spdlog/spdlog.h>
+
+// Custom modules
+#include "i2c.hpp"
+#include "relay_set.hpp"
+
 namespace kc {
 
 /* Namespace aliases and imports */
@@ -24,14 +36,73 @@ namespace ConfigConst
 
     namespace Objects
     {
+        constexpr const char* LogLevel = "log_level";
+        constexpr const char* LogAsync = "log_async";
+        constexpr const char* LogQueueSize = "log_queue_size";
+        constexpr const char* LogOverflow = "log_overflow";
         constexpr const char* HttpPort = "http_port";
+        constexpr const char* HttpThreads = "http_threads";
+        constexpr const char* HttpTimeout = "http_timeout";
+        constexpr const char* HttpIdleTimeout = "http_idle_timeout";
+        constexpr const char* HttpHeaderTimeout = "http_header_timeout";
+        constexpr const char* HttpBodyTimeout = "http_body_timeout";
+        constexpr const char* HttpMaxBody = "http_max_body";
+        constexpr const char* HttpMaxConnections = "http_max_connections";
+        constexpr const char* HttpMaxRequests = "http_max_requests";
+        constexpr const char* HttpConnectionPool = "http_connection_pool";
+        constexpr const char* HttpPipeline = "http_pipeline";
+        constexpr const char* HttpEventQueue = "http_event_queue";
+        constexpr const char* ControlPort = "control_port";
+        constexpr const char* ScheduleMaxJobs = "schedule_max_jobs";
+        constexpr const char* JournalFile = "journal_file";
+        constexpr const char* JournalSize = "journal_size";
+        constexpr const char* I2CBackend = "i2c_backend";
         constexpr const char* I2CPort = "i2c_port";
+        constexpr const char* I2CFlushWindow = "i2c_flush_window";
+        constexpr const char* I2CVerifyInterval = "i2c_verify_interval";
+        constexpr const char* I2CSimulatedLatency = "i2c_simulated_latency";
+        constexpr const char* I2CSimulatedFailureRate = "i2c_simulated_failure_rate";
+        constexpr const char* I2CSimulatedDriftRate = "i2c_simulated_drift_rate";
+        constexpr const char* Boards = "boards";
+        constexpr const char* BoardBus = "bus";
+        constexpr const char* BoardAddress = "address";
+        constexpr const char* BoardChannels = "channels";
+        constexpr const char* BoardActiveLow = "active_low";
+        constexpr const char* BoardNames = "names";
     }
 
     namespace Defaults
     {
+        constexpr const char* LogLevel = "info";
+        constexpr bool LogAsync = true;
+        constexpr int LogQueueSize = 4096;
+        constexpr const char* LogOverflow = "drop";
         constexpr uint16_t HttpPort = 80;
+        constexpr int HttpThreads = 4;
+        constexpr int HttpTimeout = 10;
+        constexpr int HttpIdleTimeout = 5;
+        constexpr int HttpHeaderTimeout = 5;
+        constexpr int HttpBodyTimeout = 10;
+        constexpr int HttpMaxBody = 65536;
+        constexpr int HttpMaxConnections = 256;
+        constexpr int HttpMaxRequests = 100;
+        constexpr int HttpConnectionPool = 64;
+        constexpr const char* HttpPipeline = "callback";
+        constexpr int HttpEventQueue = 16;
+        constexpr uint16_t ControlPort = 0;
+        constexpr int ScheduleMaxJobs = 65536;
+        constexpr const char* JournalFile = "";
+        constexpr int JournalSize = 1'048'576;
+        constexpr const char* I2CBackend = "wiringpi";
         constexpr const char* I2CPort = "/dev/i2c-1";
+        constexpr int I2CFlushWindow = 0;
+        constexpr int I2CVerifyInterval = 1000;
+        constexpr int I2CSimulatedLatency = 100;
+        constexpr double I2CSimulatedFailureRate = 0.0;
+        constexpr double I2CSimulatedDriftRate = 0.0;
+        constexpr uint8_t BoardAddresses[] = { 0x20, 0x21 };
+        constexpr int BoardChannels = 8;
+        constexpr bool BoardActiveLow = true;
     }
 }
 
@@ -41,6 +112,31 @@ public:
     // Shared config instance pointer
     using Pointer = std::shared_ptr<Config>;
 
+    // What to do with a log record when asynchronous log queue is full
+    enum class LogOverflow
+    {
+        Drop,   // Drop the record
+        Block,  // Wait until there is room in the queue
+    };
+
+    // How HTTP connections handle their requests
+    enum class HttpPipeline
+    {
+        Callback,   // Chained completion handlers
+        Coroutine,  // C++20 coroutine per connection
+    };
+
+    struct Board
+    {
+        std::string bus;                    // I2C port the board is connected to
+        uint8_t address;                    // I2C address of the board
+        int channels;                       // Count of relays on the board
+        bool activeLow;                     // Whether LOW signal enables relays instead of HIGH signal
+        std::vector<std::string> names;     // Unique names of board's relays
+
+        bool operator==(const Board& other) const = default;
+    };
+
     // Configuration file read/parse error
     class Error : public std::logic_error
     {
@@ -53,15 +149,125 @@ public:
     /// @throw std::runtime_error if file couldn't be created
     static void GenerateSampleFile();
 
+    /// @brief Get default unique name of relay
+    /// @param relay Index of relay across all boards
+    /// @return Default unique name of relay
+    static std::string DefaultRelayName(size_t relay);
+
 private:
+    // Settings that take effect without restarting when configuration file is reloaded
+    struct Settings
+    {
+        spdlog::level::level_enum logLevel;
+        std::chrono::seconds httpTimeout;
+        std::chrono::seconds httpIdleTimeout;
+        std::chrono::seconds httpHeaderTimeout;
+        std::chrono::seconds httpBodyTimeout;
+        int httpMaxBody;
+        int httpMaxConnections;
+        int httpMaxRequests;
+        HttpPipeline httpPipeline;
+        int httpEventQueue;
+        int scheduleMaxJobs;
+
+        bool operator==(const Settings& other) const = default;
+    };
+
+private:
+    /// @brief Read configuration file
+    /// @throw kc::Config::Error if reading/parsing error occurs
+    /// @return Configuration JSON
+    static json ReadFile();
+
+    /// @brief Check if relay name can be used as a resource path segment
+    /// @param name Relay name to check
+    /// @return True if name is not empty and consists of lowercase letters, digits, '-' and '_' only
+    static bool ValidRelayName(const std::string& name);
+
+private:
+    bool m_logAsync;
+    int m_logQueueSize;
+    LogOverflow m_logOverflow;
     uint16_t m_httpPort;
+    int m_httpThreads;
+    int m_httpConnectionPool;
+    uint16_t m_controlPort;
+    std::string m_journalFile;
+    int m_journalSize;
+    I2C::Backend m_i2cBackend;
     std::string m_i2cPort;
+    std::chrono::microseconds m_i2cFlushWindow;
+    std::chrono::milliseconds m_i2cVerifyInterval;
+    I2C::Simulation m_i2cSimulation;
+    std::vector<Board> m_boards;
+
+    /*
+    *   Reloadable settings are published read-copy-update style: a reload publishes a new immutable version
+    *   with a single pointer store, and readers load the pointer without locking. Replaced versions are kept
+    *   until the config is destroyed, since a reader may still use one. Reloads happen on file edits,
+    *   so there are few of them and they are small.
+    */
+    std::atomic<const Settings*> m_settings;
+    std::vector<std::unique_ptr<const Settings>> m_versions;
+    std::mutex m_reloadMutex;
+
+private:
+    /// @brief Get current version of reloadable settings
+    /// @return Current reloadable settings
+    inline const Settings& settings() const
+    {
+        return *m_settings.load(std::memory_order_acquire);
+    }
+
+    /// @brief Parse relay boards
+    /// @param configJson Configuration JSON
+    /// @throw kc::Config::Error if parsing error occurs
+    void parseBoards(const json& configJson);
 
 public:
     /// @brief Read and parse configuration file
     /// @throw kc::Config::Error if reading/parsing error occurs
     Config();
 
+    /// @brief Parse configuration JSON
+    /// @param configJson Configuration JSON
+    /// @throw kc::Config::Error if parsing error occurs
+    Config(const json& configJson);
+
+    /// @brief Apply reloadable settings of another config. Settings that require restart are left as they are.
+    /// @param next Config parsed from changed configuration file
+    /// @param restartRequired Configuration objects that differ, but take effect only after restart
+    /// @return True if any reloadable setting changed
+    bool reload(const Config& next, std::vector<std::string>& restartRequired);
+
+    /// @brief Get log level
+    /// @return Log level
+    inline spdlog::level::level_enum logLevel() const
+    {
+        return settings().logLevel;
+    }
+
+    /// @brief Check if request log records are written by a background thread
+    /// @return True if request logging is asynchronous
+    inline bool logAsync() const
+    {
+        return m_logAsync;
+    }
+
+    /// @brief Get capacity of asynchronous request log queue
+    /// @return Asynchronous request log queue capacity
+    inline int logQueueSize() const
+    {
+        return m_logQueueSize;
+    }
+
+    /// @brief Get asynchronous request log queue overflow policy
+    /// @return Asynchronous request log queue overflow policy
+    inline LogOverflow logOverflow() const
+    {
+        return m_logOverflow;
+    }
+
     /// @brief Get HTTP server port
     /// @return HTTP server port
     inline uint16_t httpPort() const
@@ -69,12 +275,152 @@ public:
         return m_httpPort;
     }
 
+    /// @brief Get HTTP server worker threads count
+    /// @return HTTP server worker threads count
+    inline int httpThreads() const
+    {
+        return m_httpThreads;
+    }
+
+    /// @brief Get time limit for producing and sending a response once its request is received
+    /// @return HTTP response time limit
+    inline std::chrono::seconds httpTimeout() const
+    {
+        return settings().httpTimeout;
+    }
+
+    /// @brief Get time limit for receiving header of a subsequent request on a persistent connection
+    /// @return HTTP idle time limit
+    inline std::chrono::seconds httpIdleTimeout() const
+    {
+        return settings().httpIdleTimeout;
+    }
+
+    /// @brief Get time limit for receiving header of the first request on a connection
+    /// @return HTTP header time limit
+    inline std::chrono::seconds httpHeaderTimeout() const
+    {
+        return settings().httpHeaderTimeout;
+    }
+
+    /// @brief Get time limit for receiving request body once its header is received
+    /// @return HTTP body time limit
+    inline std::chrono::seconds httpBodyTimeout() const
+    {
+        return settings().httpBodyTimeout;
+    }
+
+    /// @brief Get maximum size of request body
+    /// @return Maximum request body size in bytes
+    inline size_t httpMaxBody() const
+    {
+        return static_cast<size_t>(settings().httpMaxBody);
+    }
+
+    /// @brief Get maximum count of concurrent connections, requests on connections over it are rejected
+    /// @return Maximum count of concurrent connections
+    inline size_t httpMaxConnections() const
+    {
+        return static_cast<size_t>(settings().httpMaxConnections);
+    }
+
+    /// @brief Get maximum count of requests served on a single connection
+    /// @return Maximum count of requests per connection
+    inline int httpMaxRequests() const
+    {
+        return settings().httpMaxRequests;
+    }
+
+    /// @brief Get maximum count of closed HTTP connections kept for reuse
+    /// @return HTTP connection pool capacity, zero if connections aren't reused
+    inline int httpConnectionPool() const
+    {
+        return m_httpConnectionPool;
+    }
+
+    /// @brief Get how HTTP connections handle their requests
+    /// @return HTTP request pipeline
+    inline HttpPipeline httpPipeline() const
+    {
+        return settings().httpPipeline;
+    }
+
+    /// @brief Get maximum count of relay state events queued for a single event stream subscriber
+    /// @return Maximum count of queued events per subscriber
+    inline int httpEventQueue() const
+    {
+        return settings().httpEventQueue;
+    }
+
+    /// @brief Get binary control protocol port
+    /// @return Binary control protocol TCP and UDP port, zero if control server is disabled
+    inline uint16_t controlPort() const
+    {
+        return m_controlPort;
+    }
+
+    /// @brief Get maximum count of pending scheduled jobs
+    /// @return Maximum count of pending scheduled jobs
+    inline int scheduleMaxJobs() const
+    {
+        return settings().scheduleMaxJobs;
+    }
+
+    /// @brief Get relays state journal file path
+    /// @return Journal file path, empty if journal is disabled
+    inline const std::string& journalFile() const
+    {
+        return m_journalFile;
+    }
+
+    /// @brief Get relays state journal file size
+    /// @return Journal file size in bytes
+    inline size_t journalSize() const
+    {
+        return static_cast<size_t>(m_journalSize);
+    }
+
+    /// @brief Get I2C backend
+    /// @return I2C backend
+    inline I2C::Backend i2cBackend() const
+    {
+        return m_i2cBackend;
+    }
+
     /// @brief Get I2C port
     /// @return I2C port
     inline const std::string& i2cPort() const
     {
         return m_i2cPort;
     }
+
+    /// @brief Get time to coalesce relay state changes for before writing them to drivers
+    /// @return I2C flush window
+    inline std::chrono::microseconds i2cFlushWindow() const
+    {
+        return m_i2cFlushWindow;
+    }
+
+    /// @brief Get interval of reading driver states back to detect drifted outputs
+    /// @return I2C verify interval, zero if read-back is disabled
+    inline std::chrono::milliseconds i2cVerifyInterval() const
+    {
+        return m_i2cVerifyInterval;
+    }
+
+    /// @brief Get simulated I2C backend parameters
+    /// @return Simulated I2C backend parameters
+    inline const I2C::Simulation& i2cSimulation() const
+    {
+        return m_i2cSimulation;
+    }
+
+    /// @brief Get relay boards
+    /// @return Relay boards, relays are numbered across boards in their order
+    inline const std::vector<Board>& boards() const
+    {
+        return m_boards;
+    }
 };
 
 } // namespace kc
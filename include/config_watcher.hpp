@@ -0,0 +1,73 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+
+// POSIX modules
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Library spdlog
+#include <spdlog/spdlog.h>
+
+// Custom modules
+#include "config.hpp"
+#include "utility.hpp"
+
+namespace kc {
+
+/*
+*   Watches configuration file and applies its changes to the running config.
+*   The file's directory is watched rather than the file itself, so that editors
+*   replacing the file by renaming a new one over it are noticed too.
+*   A changed file is parsed and validated in full before anything is applied,
+*   so an invalid edit is reported and leaves the running config untouched.
+*/
+class ConfigWatcher
+{
+private:
+    // Shared config watcher logger instance pointer
+    using Logger = std::shared_ptr<spdlog::logger>;
+
+    // Time to wait for more changes after one, so that a file written in parts is read once
+    static constexpr int SettleTime = 100;
+
+private:
+    Logger m_logger;
+    Config::Pointer m_config;
+    int m_inotify;
+    int m_stop;
+    std::thread m_thread;
+
+private:
+    /// @brief Wait for configuration file changes and reload it until stopped
+    void run();
+
+    /// @brief Read inotify events
+    /// @return True if configuration file was changed
+    bool readEvents();
+
+    /// @brief Parse configuration file and apply its reloadable settings
+    void reload();
+
+public:
+    /// @brief Start watching configuration file
+    /// @param config Running config to apply changes to
+    /// @throw std::runtime_error if configuration file couldn't be watched
+    ConfigWatcher(Config::Pointer config);
+
+    /// @brief Stop watching configuration file
+    ~ConfigWatcher();
+};
+
+} // namespace kc
@@ -0,0 +1,244 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <chrono>
+
+// Boost libraries
+#include <boost/asio.hpp>
+#include <boost/core/ignore_unused.hpp>
+
+// Library spdlog
+#include <spdlog/spdlog.h>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Custom modules
+#include "config.hpp"
+#include "controller.hpp"
+#include "handler_memory.hpp"
+#include "listeners.hpp"
+#include "metrics.hpp"
+#include "relay_events.hpp"
+#include "utility.hpp"
+
+namespace kc {
+
+/* Namespace aliases and imports */
+namespace asio = boost::asio;
+
+/*
+*   Compact binary relay control protocol, served over both TCP and UDP on the same port.
+*   Every request is a fixed 12-byte frame and is answered with a fixed 16-byte frame,
+*   all integers are in network byte order:
+*
+*   Request:  | version: 1 | opcode: 1 | flags: 1 | bank: 1 | sequence: 4 | mask: 2 | value: 2 |
+*   Response: | version: 1 | opcode: 1 | status: 1 | bank: 1 | sequence: 4 | state version: 6 | state mask: 2 |
+*
+*   Relays are addressed in banks of 16: bit N of a mask stands for relay bank * 16 + N.
+*   The response echoes request's opcode, bank and sequence number and carries state of the bank's relays
+*   after the request was applied. All operations are idempotent,
+*   so a UDP client that got no acknowledgement may simply send the same request again.
+*/
+class ControlServer : public std::enable_shared_from_this<ControlServer>
+{
+public:
+    // Shared control server instance pointer
+    using Pointer = std::shared_ptr<ControlServer>;
+
+    // Protocol version carried in every frame
+    static constexpr uint8_t Version = 1;
+
+    // Size of request frame in bytes
+    static constexpr size_t RequestSize = 12;
+
+    // Size of response frame in bytes
+    static constexpr size_t ResponseSize = 16;
+
+    // Count of relays in a bank addressed by a single frame
+    static constexpr size_t BankRelays = 16;
+
+    enum class Opcode : uint8_t
+    {
+        GetMask = 1,    // Get relays state
+        SetMask = 2,    // Set relays in mask to corresponding bits of value
+        SetBits = 3,    // Enable relays in mask
+        ClearBits = 4,  // Disable relays in mask
+        Pulse = 5,      // Enable relays in mask and disable them after value milliseconds
+    };
+
+    enum class Status : uint8_t
+    {
+        Ok = 0,             // Request was applied
+        BadVersion = 1,     // Protocol version is not supported, TCP connection is closed after this response
+        BadOpcode = 2,      // Opcode is unknown
+        WriteFailed = 3,    // Request was applied, but drivers couldn't be written
+        BadArgument = 4,    // Bank, mask or value is out of range
+        BadFlags = 5,       // Flags aren't supported over the transport, request wasn't applied
+    };
+
+    // Request flag: acknowledge only after relays state is written to drivers, over TCP only
+    static constexpr uint8_t WaitFlag = 0x01;
+
+    struct Request
+    {
+        uint8_t version;
+        Opcode opcode;
+        uint8_t flags;
+        uint8_t bank;
+        uint32_t sequence;
+        uint16_t mask;
+        uint16_t value;
+    };
+
+    struct Response
+    {
+        uint8_t version;
+        Opcode opcode;
+        Status status;
+        uint8_t bank;
+        uint32_t sequence;
+        uint64_t stateVersion;
+        uint16_t mask;      // State of bank's relays
+    };
+
+    /// @brief Encode request frame
+    /// @param request Request to encode
+    /// @param frame Frame of RequestSize bytes to encode to
+    static void EncodeRequest(const Request& request, uint8_t* frame);
+
+    /// @brief Decode request frame
+    /// @param frame Frame of RequestSize bytes to decode
+    /// @return Decoded request
+    static Request DecodeRequest(const uint8_t* frame);
+
+    /// @brief Encode response frame
+    /// @param response Response to encode
+    /// @param frame Frame of ResponseSize bytes to encode to
+    static void EncodeResponse(const Response& response, uint8_t* frame);
+
+    /// @brief Decode response frame
+    /// @param frame Frame of ResponseSize bytes to decode
+    /// @return Decoded response
+    static Response DecodeResponse(const uint8_t* frame);
+
+private:
+    // Shared server logger instance pointer
+    using Logger = std::shared_ptr<spdlog::logger>;
+
+    // Strand that serializes handlers of a single connection
+    using Strand = RelayEvents::Strand;
+
+    // Connection socket bound to its strand
+    using Socket = RelayEvents::Socket;
+
+    // Count of frames received and sent in a single read or write
+    static constexpr size_t BatchFrames = 64;
+
+    // Delay of accepting again after accept failed, running out of file descriptors is usually only temporary
+    static constexpr std::chrono::milliseconds AcceptRetryDelay = std::chrono::milliseconds(100);
+
+    enum Counter
+    {
+        TcpRequests,
+        UdpRequests,
+        Errors,
+        Dropped,
+        Opened,
+        Closed,
+        AcceptErrors,
+        CountersCount,
+    };
+
+    class Connection : public std::enable_shared_from_this<Connection>
+    {
+    private:
+        ControlServer::Pointer m_server;
+        HandlerMemory m_handlerMemory;
+        Socket m_socket;
+        std::array<uint8_t, RequestSize * BatchFrames> m_requests;
+        std::array<uint8_t, ResponseSize * BatchFrames> m_responses;
+        std::array<bool, BatchFrames> m_waiting;
+        size_t m_received;
+
+    private:
+        /// @brief Receive next batch of request frames
+        void receive();
+
+        /// @brief Send responses to received request frames
+        /// @param frames Count of complete request frames received
+        void respond(size_t frames);
+
+        /// @brief Send answered responses
+        /// @param answered Count of responses to send
+        /// @param supported False if the connection must be closed after responses are sent
+        void send(size_t answered, bool supported);
+
+    public:
+        /// @brief Initialize connection
+        /// @param server Control server
+        /// @param socket Connection socket
+        Connection(ControlServer::Pointer server, Socket&& socket);
+
+        ~Connection();
+
+        /// @brief Start handling requests
+        void start();
+    };
+
+private:
+    Logger m_logger;
+    Config::Pointer m_config;
+    Controller::Pointer m_controller;
+    asio::io_context& m_context;
+    asio::ip::tcp::acceptor m_acceptor;
+    asio::steady_timer m_acceptRetry;
+    asio::ip::udp::socket m_udpSocket;
+    asio::ip::udp::endpoint m_udpPeer;
+    std::array<uint8_t, RequestSize + 1> m_udpRequest;
+    std::array<uint8_t, ResponseSize> m_udpResponse;
+    HandlerMemory m_udpHandlerMemory;
+    Metrics::CounterSet m_counters;
+
+private:
+    /// @brief Apply request to controller
+    /// @param frame Request frame
+    /// @param response Response frame to fill
+    /// @param waiting Set if the response must wait for drivers to be written, null if the transport can't wait and WaitFlag is rejected
+    /// @return False if the request has unsupported protocol version
+    bool apply(const uint8_t* frame, uint8_t* response, bool* waiting);
+
+    /// @brief Start accepting TCP connections
+    void startAccepting();
+
+    /// @brief Start receiving UDP datagrams
+    void startReceiving();
+
+    /// @brief Handle received UDP datagram and all datagrams already queued after it
+    /// @param size Size of received datagram
+    void handleDatagram(size_t size);
+
+public:
+    /// @brief Initialize control server and open its sockets
+    /// @param config Initialized config, its control port must not be zero
+    /// @param controller Relay controller
+    /// @param context Context to handle requests in, must not run after control server is destroyed
+    /// @param listeners Listening sockets to take control port's sockets from
+    /// @throw std::runtime_error if sockets couldn't be opened
+    ControlServer(Config::Pointer config, Controller::Pointer controller, asio::io_context& context, Listeners& listeners);
+
+    /// @brief Start serving requests
+    void start();
+
+    /// @brief Write control server metrics in Prometheus text format
+    /// @param metrics String to append to
+    void writeMetrics(std::string& metrics) const;
+};
+
+} // namespace kc
@@ -2,16 +2,33 @@
 
 // STL modules
 #include <memory>
-#include <map>
+#include <functional>
+#include <vector>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
 #include <stdexcept>
 
+// POSIX modules
+#include <pthread.h>
+
 // Library {fmt}
 #include <fmt/format.h>
 
 // Custom modules
 #include "config.hpp"
-#include "i2c.hpp"
+#include "journal.hpp"
+#include "metrics.hpp"
+#include "output_stage.hpp"
+#include "relay_set.hpp"
 
 namespace kc {
 
@@ -21,74 +38,195 @@ public:
     // Shared controller instance pointer
     using Pointer = std::shared_ptr<Controller>;
 
-    enum class Relay
-    {
-        One,
-        Two,
-        Three,
-        Four,
-        Five,
-        Six,
-        Seven,
-        Eight,
-        Nine,
-        Ten,
-        Eleven,
-        Twelve,
-        Thirteen,
-        Fourteen,
-        Fifteen,
-        Sixteen,
-        MaxRelays,
-    };
+    // Index of relay, relays are numbered across configured boards in their order
+    using Relay = size_t;
 
     struct State
     {
         bool enabled;
     };
 
+    // Relays set: relay N is in the set when it is enabled
+    using Mask = RelaySet;
+
+    struct Snapshot
+    {
+        uint64_t version;
+        Mask mask;
+    };
+
+    // Function called after relays state changes, must return without blocking
+    using Listener = std::function<void(const Snapshot&)>;
+
+    // Longest accepted pulse
+    static constexpr std::chrono::milliseconds MaxPulse = std::chrono::hours(1);
+
 private:
-    /// @brief Get relay's control mask
-    /// @param relay Relay whose control mask to get
-    /// @throw std::runtime_error if relay is unknown
-    /// @return Relay's control mask
-    static uint16_t ControlMask(Relay relay);
+    struct Board
+    {
+        std::string device; // I2C port and address of the board
+        Relay first;        // First relay of the board
+        int channels;
+        bool activeLow;
+        size_t offset;      // Offset of board's state in driver states
+        size_t width;       // Count of state bytes written to the board
+    };
 
-public:
-    /// @brief Get relay's unique name
-    /// @param relay Relay whose unique name to get
-    /// @throw std::runtime_error if relay is unknown
-    /// @return Relay's unique name
-    static const char* UniqueName(Relay relay);
+    // Hash that allows looking up relays by std::string_view without constructing std::string
+    struct Hash
+    {
+        using is_transparent = void;
+
+        inline size_t operator()(std::string_view name) const
+        {
+            return std::hash<std::string_view>()(name);
+        }
+    };
+
+    // Release time of a relay that isn't pulsing
+    static constexpr std::chrono::steady_clock::time_point NoRelease = std::chrono::steady_clock::time_point::max();
 
-    /// @brief Get relay's name
-    /// @param relay Relay whose name to get
-    /// @throw std::runtime_error if relay is unknown
-    /// @return Relay's name
-    static const char* Name(Relay relay);
+private:
+    /// @brief Open relay driver devices
+    /// @param config Initialized config
+    /// @throw std::runtime_error if internal error occurs
+    /// @return Opened driver devices
+    static std::vector<OutputStage::Driver> OpenDrivers(const Config& config);
 
 private:
+    std::vector<Board> m_boards;
+    std::vector<std::string> m_names;
+    std::unordered_map<std::string, Relay, Hash, std::equal_to<>> m_relays;
+    std::vector<Relay> m_ordered;
+    std::vector<uint32_t> m_ranks;
+    Mask m_allRelays;
+
+    /*
+    *   Relays state is guarded by a sequence lock: the sequence is odd while a writer changes state words,
+    *   and a reader retries if the sequence changed while it copied them. Readers never block writers,
+    *   and a consistent snapshot of hundreds of relays costs a few loads. Writers are serialized by the update lock.
+    *   State version is half of the sequence.
+    */
+    size_t m_words;
+    std::atomic<uint64_t> m_sequence;
+    std::array<std::atomic<uint64_t>, RelaySet::Words> m_state;
+
     std::mutex m_mutex;
-    std::map<Relay, State> m_relays;
-    I2C::Device m_driver1;
-    I2C::Device m_driver2;
+    std::vector<uint8_t> m_driverStates;
+    OutputStage m_output;
+    Metrics::CounterSet m_toggles;
+    Listener m_listener;
+    std::mutex m_updateMutex;
+    std::condition_variable m_pulseCondition;
+    std::vector<std::chrono::steady_clock::time_point> m_releases;
+    Mask m_pulsing;
+    Metrics::CounterSet m_pulses;
+    Metrics::HistogramSet m_releaseLateness;
+    Journal::Pointer m_journal;
+    Mask m_journaled;           // Relays state last recorded in journal, pulsing relays are recorded released
+    uint64_t m_journalVersion;  // Version last recorded in journal
+    bool m_pulseStop;
+    std::thread m_pulseThread;
 
 private:
-    /// @brief Switch relays to their states
+    /// @brief Submit relays current states to drivers
     /// @param force Whether or not to force state switch
-    void switchRelays(bool force = false);
+    /// @return Output stage submission sequence number
+    uint64_t switchRelays(bool force = false);
+
+    /// @brief Update relays state without touching pending pulse releases, update lock must be held
+    /// @param mask Relays to update
+    /// @param value New state of relays in mask
+    /// @return State snapshot after update
+    Snapshot apply(const Mask& mask, const Mask& value);
+
+    /// @brief Record relays state in journal if it is enabled, update lock must be held
+    /// @param snapshot Current state snapshot
+    void journal(const Snapshot& snapshot);
+
+    /// @brief Release pulsing relays when their pulses end until stopped
+    void runPulses();
 
 public:
-    /// @brief Initialize relay controller
+    /// @brief Initialize relay controller, restoring relays state from journal if it is enabled
     /// @param config Initialized config
+    /// @throw std::runtime_error if internal error occurs
     Controller(Config::Pointer config);
 
+    /// @brief Stop relay controller, releasing pulsing relays and disabling all relays unless their state is journaled
     ~Controller();
 
+    /// @brief Get count of relays
+    /// @return Count of relays on all boards
+    inline size_t relays() const
+    {
+        return m_names.size();
+    }
+
+    /// @brief Get set of all relays
+    /// @return Set of all relays on all boards
+    inline const Mask& allRelays() const
+    {
+        return m_allRelays;
+    }
+
+    /// @brief Get relay's unique name
+    /// @param relay Relay whose unique name to get, must be less than relays()
+    /// @return Relay's unique name
+    inline const std::string& uniqueName(Relay relay) const
+    {
+        return m_names[relay];
+    }
+
+    /// @brief Get position of relay among all relays ordered by their unique names
+    /// @param relay Relay whose position to get, must be less than relays()
+    /// @return Relay's position in unique name order
+    inline uint32_t rank(Relay relay) const
+    {
+        return m_ranks[relay];
+    }
+
+    /// @brief Get all relays ordered by their unique names, the way JSON objects order their keys
+    /// @return Ordered relays
+    inline const std::vector<Relay>& orderedRelays() const
+    {
+        return m_ordered;
+    }
+
+    /// @brief Find relay by its unique name
+    /// @param uniqueName Unique name of relay to find
+    /// @return Found relay or std::nullopt if no relay has this unique name
+    std::optional<Relay> find(std::string_view uniqueName) const;
+
+    /// @brief Get state version
+    /// @return State version, incremented on every relay state change
+    uint64_t version() const;
+
+    /// @brief Get consistent snapshot of all relays state
+    /// @return All relays state snapshot
+    Snapshot snapshot() const;
+
     /// @brief Get relay state
     /// @param relay Relay whose state to get
     /// @throw std::invalid_argument if relay is unknown
-    State getState(Relay relay);
+    State getState(Relay relay) const;
+
+    /// @brief Atomically update relays state, cancelling pending releases of pulsing relays in mask.
+    /// Relays that aren't configured are ignored.
+    /// @param mask Relays to update
+    /// @param value New state of relays in mask
+    /// @return State snapshot after update
+    Snapshot update(const Mask& mask, const Mask& value);
+
+    /// @brief Enable relays and disable them after given time.
+    /// Pulsing a relay that is already pulsing restarts its pulse with the new duration,
+    /// changing a pulsing relay's state in any other way cancels its release.
+    /// Relays that aren't configured are ignored.
+    /// @param mask Relays to pulse
+    /// @param duration Pulse duration
+    /// @throw std::invalid_argument if duration is not positive or is longer than MaxPulse
+    /// @return State snapshot after relays are enabled
+    Snapshot pulse(const Mask& mask, std::chrono::milliseconds duration);
 
     /// @brief Set relay state
     /// @param relay Relay whose state to set
@@ -99,11 +237,22 @@ public:
     /// @brief Set all relays state
     /// @param enabled Whether or not to switch all relays to enabled state
     void setAllStates(bool enabled);
-};
 
-/// @brief Increment relay enumerator
-/// @param relay Relay enumerator to increment
-/// @return Incremented relay enumerator
-Controller::Relay& operator++(Controller::Relay& relay);
+    /// @brief Set relays state change listener
+    /// @param listener Listener to set, empty listener removes the current one
+    void listen(Listener listener);
+
+    /// @brief Wait until all state changes made so far are written to drivers
+    /// @return True if drivers were written successfully
+    bool flush();
+
+    /// @brief Call completion once all state changes made so far are written to drivers
+    /// @param completion Function to call with whether or not drivers were written successfully, must return without blocking
+    void flush(OutputStage::Completion completion);
+
+    /// @brief Write controller metrics in Prometheus text format
+    /// @param metrics String to append to
+    void writeMetrics(std::string& metrics) const;
+};
 
 } // namespace kc
@@ -0,0 +1,201 @@
+#pragma once
+
+// STL modules
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Boost libraries
+#include <boost/asio/async_result.hpp>
+
+namespace kc {
+
+/*
+*   Storage for asynchronous operation states of a single connection.
+*   Asio allocates an operation state through the completion handler's associated allocator
+*   every time an operation is started; with this storage, states of a connection's
+*   operations reuse the same few blocks instead of going through the heap.
+*/
+class HandlerMemory
+{
+public:
+    // Count of blocks, enough for all operations a connection may have in flight at once
+    static constexpr size_t BlocksCount = 4;
+
+    // Size of a block, states that don't fit are allocated from the heap
+    static constexpr size_t BlockSize = 512;
+
+private:
+    struct alignas(std::max_align_t) Block
+    {
+        std::byte storage[BlockSize];
+    };
+
+private:
+    Block m_blocks[BlocksCount];
+    std::atomic<bool> m_used[BlocksCount];
+
+public:
+    HandlerMemory();
+
+    HandlerMemory(const HandlerMemory&) = delete;
+
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    /// @brief Allocate operation state storage
+    /// @param size Size of operation state
+    /// @throw std::bad_alloc if heap allocation fails
+    /// @return Allocated storage
+    void* allocate(size_t size);
+
+    /// @brief Deallocate operation state storage
+    /// @param pointer Storage to deallocate
+    /// @param size Size of operation state
+    void deallocate(void* pointer, size_t size);
+};
+
+template <typename Type>
+class HandlerAllocator
+{
+public:
+    template <typename Other>
+    friend class HandlerAllocator;
+
+    using value_type = Type;
+
+private:
+    HandlerMemory* m_memory;
+
+public:
+    /// @brief Initialize allocator
+    /// @param memory Handler memory to allocate from
+    explicit HandlerAllocator(HandlerMemory& memory)
+        : m_memory(&memory)
+    {}
+
+    template <typename Other>
+    HandlerAllocator(const HandlerAllocator<Other>& other)
+        : m_memory(other.m_memory)
+    {}
+
+    /// @brief Allocate objects storage
+    /// @param count Count of objects
+    /// @return Allocated storage
+    Type* allocate(size_t count)
+    {
+        return static_cast<Type*>(m_memory->allocate(count * sizeof(Type)));
+    }
+
+    /// @brief Deallocate objects storage
+    /// @param pointer Storage to deallocate
+    /// @param count Count of objects
+    void deallocate(Type* pointer, size_t count)
+    {
+        m_memory->deallocate(pointer, count * sizeof(Type));
+    }
+
+    template <typename Other>
+    bool operator==(const HandlerAllocator<Other>& other) const
+    {
+        return m_memory == other.m_memory;
+    }
+
+    template <typename Other>
+    bool operator!=(const HandlerAllocator<Other>& other) const
+    {
+        return m_memory != other.m_memory;
+    }
+};
+
+/*
+*   Completion handler whose associated allocator allocates from handler memory.
+*   Handler memory must outlive the handler: handlers are expected to keep their connection alive.
+*/
+template <typename Handler>
+class BoundHandler
+{
+public:
+    using allocator_type = HandlerAllocator<std::byte>;
+
+private:
+    HandlerMemory* m_memory;
+    Handler m_handler;
+
+public:
+    /// @brief Bind handler to handler memory
+    /// @param memory Handler memory to allocate operation states from
+    /// @param handler Bound handler
+    BoundHandler(HandlerMemory& memory, Handler handler)
+        : m_memory(&memory)
+        , m_handler(std::move(handler))
+    {}
+
+    /// @brief Get associated allocator
+    /// @return Allocator of handler memory
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type(*m_memory);
+    }
+
+    template <typename... Arguments>
+    void operator()(Arguments&&... arguments)
+    {
+        m_handler(std::forward<Arguments>(arguments)...);
+    }
+};
+
+/// @brief Bind handler to handler memory
+/// @param memory Handler memory to allocate operation states from
+/// @param handler Handler to bind
+/// @return Bound handler
+template <typename Handler>
+inline BoundHandler<std::decay_t<Handler>> BindHandler(HandlerMemory& memory, Handler&& handler)
+{
+    return BoundHandler<std::decay_t<Handler>>(memory, std::forward<Handler>(handler));
+}
+
+/*
+*   Completion token whose handlers are bound to handler memory.
+*   Used with tokens like boost::asio::use_awaitable, whose handlers are created by the token itself.
+*/
+template <typename Token>
+struct BoundToken
+{
+    HandlerMemory* memory;
+    Token token;
+};
+
+/// @brief Bind completion token's handlers to handler memory
+/// @param memory Handler memory to allocate operation states from
+/// @param token Token to bind
+/// @return Bound token
+template <typename Token>
+inline BoundToken<std::decay_t<Token>> BindToken(HandlerMemory& memory, Token&& token)
+{
+    return { &memory, std::forward<Token>(token) };
+}
+
+} // namespace kc
+
+namespace boost::asio {
+
+template <typename Token, typename Signature>
+class async_result<kc::BoundToken<Token>, Signature>
+{
+public:
+    using return_type = typename async_result<Token, Signature>::return_type;
+
+    template <typename Initiation, typename... Arguments>
+    static return_type initiate(Initiation&& initiation, kc::BoundToken<Token> token, Arguments&&... arguments)
+    {
+        // Handler created by the wrapped token is bound before the operation is initiated with it
+        return async_initiate<Token, Signature>([memory = token.memory, initiation = std::forward<Initiation>(initiation)](auto&& handler, auto&&... arguments) mutable
+        {
+            std::move(initiation)(kc::BindHandler(*memory, std::forward<decltype(handler)>(handler)), std::forward<decltype(arguments)>(arguments)...);
+        }, token.token, std::forward<Arguments>(arguments)...);
+    }
+};
+
+} // namespace boost::asio
@@ -2,14 +2,23 @@
 
 // STL modules
 #include <memory>
+#include <string_view>
 #include <chrono>
 #include <functional>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <charconv>
+#include <cstddef>
+#include <atomic>
 
 // Boost libraries
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/asio.hpp>
-#include <boost/beast/core/buffers_to_string.hpp>
 
 // Library nlohmann::json
 #include <nlohmann/json.hpp>
@@ -18,8 +27,18 @@
 #include <fmt/format.h>
 
 // Custom modules
+#include "arena.hpp"
 #include "config.hpp"
+#include "control_server.hpp"
 #include "controller.hpp"
+#include "handler_memory.hpp"
+#include "listeners.hpp"
+#include "metrics.hpp"
+#include "relay_events.hpp"
+#include "request_log.hpp"
+#include "router.hpp"
+#include "scheduler.hpp"
+#include "state_cache.hpp"
 #include "utility.hpp"
 
 namespace kc {
@@ -35,47 +54,365 @@ private:
     // Shared server logger instance pointer
     using Logger = std::shared_ptr<spdlog::logger>;
 
+    // Strand used to serialize handlers
+    using Strand = RelayEvents::Strand;
+
+    // Connection socket bound to its strand
+    using Socket = RelayEvents::Socket;
+
+    // Timer bound to connection's strand
+    using Timer = RelayEvents::Timer;
+
+    // Delay of accepting again after accept failed, running out of file descriptors is usually only temporary
+    static constexpr std::chrono::milliseconds AcceptRetryDelay = std::chrono::milliseconds(100);
+
+    class Connection;
+
+    // Stage of request handling that connection's deadline applies to
+    enum class Phase
+    {
+        Header,     // Receiving request header
+        Body,       // Receiving request body
+        Response,   // Producing and sending response
+    };
+
+    // Reason of rejecting a request without routing it
+    enum class Rejection
+    {
+        Overload,       // Too many concurrent connections
+        BodyTooLarge,   // Request body is larger than allowed
+        AcceptFailed,   // Connection couldn't be accepted, for example for running out of file descriptors
+    };
+
+    // Function that generates response to routed request
+    using RouteHandler = std::function<void(Connection&, int)>;
+
+    // Table that routes requests to response handlers
+    using RouteTable = Router<RouteHandler>;
+
+    // Shared route table instance pointer
+    using Routes = std::shared_ptr<const RouteTable>;
+
+    class Statistics
+    {
+    public:
+        // Shared statistics instance pointer
+        using Pointer = std::shared_ptr<Statistics>;
+
+        // Response statuses counted separately, all others are counted as "other"
+        static constexpr unsigned Statuses[] = { 200, 400, 404, 405, 413, 500, 503 };
+
+    private:
+        std::vector<std::string> m_routes;
+        Metrics::CounterSet m_requests;
+        Metrics::HistogramSet m_durations;
+        Metrics::CounterSet m_connections;
+        Metrics::CounterSet m_timeouts;
+        Metrics::CounterSet m_rejections;
+
+    public:
+        /// @brief Initialize statistics
+        /// @param routes Route table
+        Statistics(const RouteTable& routes);
+
+        /// @brief Count opened connection
+        void connectionOpened();
+
+        /// @brief Count closed connection
+        void connectionClosed();
+
+        /// @brief Count connection object that was created to accept a connection
+        void connectionCreated();
+
+        /// @brief Count connection object that was taken from pool to accept a connection
+        void connectionReused();
+
+        /// @brief Count connection closed for missing its deadline
+        /// @param phase Phase the deadline was missed in
+        void timedOut(Phase phase);
+
+        /// @brief Count request rejected without routing
+        /// @param reason Rejection reason
+        void rejected(Rejection reason);
+
+        /// @brief Count handled request
+        /// @param route Index of requested resource
+        /// @param status Response status
+        /// @param duration Time spent handling request
+        void request(size_t route, unsigned status, std::chrono::nanoseconds duration);
+
+        /// @brief Write statistics in Prometheus text format
+        /// @param metrics String to append to
+        void write(std::string& metrics) const;
+    };
+
+    /*
+    *   Closed connections are kept for reuse up to pool capacity, so an accepted connection gets
+    *   the warm buffers, arena and strand of a previous one instead of allocating them.
+    *   Control blocks of connections' shared ownership are cached by the pool as well.
+    *   The pool must outlive all connections.
+    */
+    class ConnectionPool
+    {
+    public:
+        // Size of a cached control block, larger ones are allocated from the heap
+        static constexpr size_t BlockSize = 128;
+
+        // Allocator of connection's shared ownership control block
+        template <typename Type>
+        class Allocator
+        {
+        public:
+            template <typename Other>
+            friend class Allocator;
+
+            using value_type = Type;
+
+        private:
+            ConnectionPool* m_pool;
+
+        public:
+            /// @brief Initialize allocator
+            /// @param pool Pool to allocate from
+            explicit Allocator(ConnectionPool& pool)
+                : m_pool(&pool)
+            {}
+
+            template <typename Other>
+            Allocator(const Allocator<Other>& other)
+                : m_pool(other.m_pool)
+            {}
+
+            /// @brief Allocate objects storage
+            /// @param count Count of objects
+            /// @return Allocated storage
+            Type* allocate(size_t count)
+            {
+                return static_cast<Type*>(m_pool->allocate(count * sizeof(Type)));
+            }
+
+            /// @brief Deallocate objects storage
+            /// @param pointer Storage to deallocate
+            /// @param count Count of objects
+            void deallocate(Type* pointer, size_t count)
+            {
+                m_pool->deallocate(pointer, count * sizeof(Type));
+            }
+
+            template <typename Other>
+            bool operator==(const Allocator<Other>& other) const
+            {
+                return m_pool == other.m_pool;
+            }
+
+            template <typename Other>
+            bool operator!=(const Allocator<Other>& other) const
+            {
+                return m_pool != other.m_pool;
+            }
+        };
+
+        // Deleter that returns connection to pool once it's no longer owned
+        struct Recycler
+        {
+            ConnectionPool* pool;
+
+            void operator()(Connection* connection) const;
+        };
+
+    private:
+        struct alignas(std::max_align_t) Block
+        {
+            std::byte storage[BlockSize];
+        };
+
+    private:
+        std::mutex m_mutex;
+        size_t m_capacity;
+        std::vector<std::unique_ptr<Connection>> m_idle;
+        std::vector<std::unique_ptr<Block>> m_blocks;
+        std::atomic<size_t> m_open;
+        bool m_closed;
+
+    public:
+        /// @brief Initialize connection pool
+        /// @param capacity Maximum count of idle connections kept
+        ConnectionPool(size_t capacity);
+
+        ~ConnectionPool();
+
+        /// @brief Take idle connection
+        /// @return Idle connection or nullptr if pool is empty
+        std::unique_ptr<Connection> take();
+
+        /// @brief Count connection that is opened
+        /// @return Count of open connections including this one
+        size_t open();
+
+        /// @brief Close connection and keep it for reuse, destroying it if pool is full or closed
+        /// @param connection Connection to recycle
+        void recycle(Connection* connection);
+
+        /// @brief Destroy idle connections and stop keeping recycled ones.
+        /// Connections belong to the I/O context, so this must be called before the context is destroyed.
+        void close();
+
+        /// @brief Allocate control block storage
+        /// @param size Size of control block
+        /// @throw std::bad_alloc if heap allocation fails
+        /// @return Allocated storage
+        void* allocate(size_t size);
+
+        /// @brief Deallocate control block storage
+        /// @param pointer Storage to deallocate
+        /// @param size Size of control block
+        void deallocate(void* pointer, size_t size);
+    };
+
     class Connection : public std::enable_shared_from_this<Connection>
     {
     private:
-        // Function used to create connection's log message
-        using LogMessageFunction = std::function<std::string(std::string)>;
+        // Request body allocated from connection's arena
+        using RequestBody = beast::http::basic_string_body<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+        // Header fields allocated from connection's arena
+        using Fields = beast::http::basic_fields<ArenaAllocator<char>>;
+
+        // Parsed request
+        using Request = beast::http::request<RequestBody, Fields>;
+
+        // Parser of a single request
+        using RequestParser = beast::http::request_parser<RequestBody, ArenaAllocator<char>>;
+
+        // Produced response
+        using Response = beast::http::response<beast::http::string_body, Fields>;
+
+        // Coroutine that handles connection's requests, bound to connection's strand without type erasure
+        using Coroutine = asio::awaitable<void, Strand>;
+
+        // Completion token that resumes connection's coroutine
+        using UseAwaitable = asio::use_awaitable_t<Strand>;
+
+        // Capacity of connection's arena, enough for headers and bodies of typical requests and responses
+        static constexpr size_t ArenaCapacity = 1024 * 8;
 
         struct Target
         {
-            std::string resource;
-            std::string query;
+            std::string_view resource;
+            std::string_view query;
         };
 
+    public:
+        /// @brief Create route table of all resources
+        /// @return Created route table
+        static Routes CreateRoutes();
+
     private:
         /// @brief Deduce response indentation from request query
         /// @param query Request query
         /// @return Response indentation
-        static int GetIndentation(const std::string& query);
+        static int GetIndentation(std::string_view query);
+
+        /// @brief Deduce from request query whether to wait for relay state changes to be written
+        /// @param query Request query
+        /// @return True if response should be sent only after changes are written
+        static bool GetWait(std::string_view query);
 
         /// @brief Parse target resource and query
         /// @param target Target string to parse
         /// @return Parsed target
-        static Target ParseTarget(const std::string& target);
+        static Target ParseTarget(std::string_view target);
+
+        /// @brief Parse relays update from request JSON
+        /// @param controller Relay controller that names the relays
+        /// @param requestJson Request JSON, either {"set": [...], "clear": [...]} with relays' unique names or {"mask": <mask>, "value": <value>}
+        /// @param mask Parsed mask of updated relays
+        /// @param value Parsed new state of updated relays
+        /// @throw nlohmann::json::exception if request JSON has wrong structure
+        /// @throw std::invalid_argument if request JSON addresses unknown relays or sets and clears the same relay
+        static void ParseUpdate(const Controller& controller, const json& requestJson, Controller::Mask& mask, Controller::Mask& value);
+
+        /// @brief Convert scheduled job to JSON
+        /// @param controller Relay controller that names the relays
+        /// @param job Scheduled job
+        /// @return Job JSON
+        static json JobJson(const Controller& controller, const Scheduler::Job& job);
+
+        /// @brief Parse requested relay state from request body
+        /// @param body Request body
+        /// @throw nlohmann::json::exception if body is not a JSON object with boolean "enabled" value
+        /// @return True if relays should be enabled
+        static bool GetEnabled(std::string_view body);
+
+        /// @brief Parse requested pulse duration from request body
+        /// @param body Request body
+        /// @throw nlohmann::json::exception if body mentions a pulse, but is not a JSON object with integer "pulse_ms" value
+        /// @throw std::invalid_argument if body mentions a pulse along with relay state
+        /// @return Pulse duration or std::nullopt if body doesn't request a pulse
+        static std::optional<std::chrono::milliseconds> GetPulse(std::string_view body);
 
     private:
-        Logger m_logger;
-        LogMessageFunction m_logMessage;
+        RequestLog::Pointer m_requestLog;
         Config::Pointer m_config;
         Controller::Pointer m_controller;
-        asio::ip::tcp::socket m_socket;
+        StateCache::Pointer m_stateCache;
+        RelayEvents::Pointer m_events;
+        ControlServer::Pointer m_control;
+        Scheduler::Pointer m_scheduler;
+        Routes m_routes;
+        Statistics::Pointer m_statistics;
+        Strand m_controllerStrand;
+        HandlerMemory m_handlerMemory;
+        Socket m_socket;
+        asio::ip::address m_address;
         beast::flat_buffer m_buffer;
-        beast::http::request<beast::http::dynamic_body> m_request;
-        beast::http::response<beast::http::dynamic_body> m_response;
-        asio::steady_timer m_timeout;
+        Arena m_arena;
+        std::optional<RequestParser> m_parser;
+        std::optional<Response> m_response;
+        Timer m_timeout;
+        int m_requests;
+        size_t m_route;
+        std::string_view m_routeParameter;
+        std::chrono::steady_clock::time_point m_requestStart;
+        Phase m_phase;
+        std::chrono::steady_clock::time_point m_deadline;
+        bool m_waiting;
+        bool m_overloaded;
+        bool m_subscribing;
+        bool m_flushing;    // Whether or not response is sent only once state changes are written to drivers
 
     private:
+        /// @brief Get current request
+        /// @return Current request
+        inline Request& request()
+        {
+            return m_parser->get();
+        }
+
+        /// @brief Prepare request parser and response for next request
+        void resetMessages();
+
+        /// @brief Log current request and its response
+        /// @param level Log level
+        /// @param message Log message, must be a string literal
+        void log(spdlog::level::level_enum level, const char* message);
+
         /// @brief Generate generic "404 Not Found" response
         void notFound();
 
         /// @brief Generate generic "405 Method Not Allowed" response
         void methodNotAllowed();
 
+        /// @brief Generate generic "400 Bad Request" response
+        void badRequest();
+
+        /// @brief Generate "500 Internal Server Error" response for failed relay state write
+        void writeFailed();
+
+        /// @brief Generate response that rejects request without routing it and closes connection
+        /// @param reason Rejection reason
+        void reject(Rejection reason);
+
         /// @brief Generate "/relays" resource GET response
         /// @param indentation Response indentation
         void getRelays(int indentation);
@@ -84,42 +421,120 @@ private:
         /// @param indentation Response indentation
         void postRelays(int indentation);
 
+        /// @brief Generate "/relays" resource PATCH response
+        /// @param indentation Response indentation
+        void patchRelays(int indentation);
+
+        /// @brief Generate "/relays/events" resource GET response
+        /// @param indentation Response indentation, unused
+        void getEvents(int indentation);
+
+        /// @brief Generate "/metrics" resource GET response
+        /// @param indentation Response indentation, unused
+        void getMetrics(int indentation);
+
+        /// @brief Generate "/schedules" resource GET response
+        /// @param indentation Response indentation
+        void getSchedules(int indentation);
+
+        /// @brief Generate "/schedules" resource POST response
+        /// @param indentation Response indentation
+        void postSchedules(int indentation);
+
+        /// @brief Generate "/schedules/<id>" resource GET response
+        /// @param indentation Response indentation
+        void getSchedule(int indentation);
+
+        /// @brief Generate "/schedules/<id>" resource DELETE response
+        /// @param indentation Response indentation
+        void deleteSchedule(int indentation);
+
         /// @brief Generate "/relays/<relay>" resource GET response
-        /// @param relay Accessed relay
         /// @param indentation Response indentation
-        void getRelay(Controller::Relay relay, int indentation);
+        void getRelay(int indentation);
 
-        /// @brief Generate "/relays/<relay>" resource POST response
-        /// @param relay Accessed relay
+        /// @brief Generate "/relays/<relay>" resource POST response, switching or pulsing the relay
         /// @param indentation Response indentation
-        void postRelay(Controller::Relay relay, int indentation);
+        void postRelay(int indentation);
 
     private:
+        /// @brief Move connection's deadline to given phase
+        /// @param phase Phase of request handling
+        /// @param timeout Time limit of phase
+        void setDeadline(Phase phase, std::chrono::seconds timeout);
+
+        /// @brief Wait for connection's deadline and close connection once it passes
+        void waitDeadline();
+
+        /// @brief Route received request and respond to it
+        void dispatchRequest();
+
         /// @brief Produce HTTP request response
         void produceResponse();
 
-        /// @brief Send produced response
+        /// @brief Send produced response and wait for next request if connection is kept alive
         void sendResponse();
 
+        /// @brief Handle requests of connection one after another until it's closed
+        /// @return Coroutine that handles connection's requests
+        Coroutine serve();
+
     public:
+        /// @brief Start handling requests of accepted connection
+        /// @param connection Connection whose socket accepted a client
+        /// @param address Client address
+        /// @param pool Pool to return connection to once it's closed
+        /// @param overloaded Whether or not the server has too many connections, so that requests are rejected
+        static void Start(std::unique_ptr<Connection> connection, const asio::ip::address& address, ConnectionPool& pool, bool overloaded);
+
         /// @brief Initialize connection
-        /// @param logger HTTP server logger
+        /// @param requestLog Request log
         /// @param config Initialized config
         /// @param controller Relay controller
-        /// @param socket Connection socket
-        Connection(Logger logger, Config::Pointer config, Controller::Pointer controller, asio::ip::tcp::socket& socket);
+        /// @param stateCache Serialized relays state cache
+        /// @param events Relay state change events
+        /// @param control Binary control server, null if it is disabled
+        /// @param scheduler Scheduled jobs
+        /// @param routes Route table
+        /// @param statistics Server statistics
+        /// @param controllerStrand Strand that serializes controller mutations
+        /// @param strand Strand that serializes connection's handlers, kept across reuses
+        Connection(RequestLog::Pointer requestLog, Config::Pointer config, Controller::Pointer controller, StateCache::Pointer stateCache, RelayEvents::Pointer events, ControlServer::Pointer control, Scheduler::Pointer scheduler, Routes routes, Statistics::Pointer statistics, Strand controllerStrand, Strand strand);
+
+        /// @brief Get connection socket
+        /// @return Connection socket
+        inline Socket& socket()
+        {
+            return m_socket;
+        }
 
-        /// @brief Handle HTTP request
+        /// @brief Close connection, making it ready to accept another client
+        void close();
+
+        /// @brief Handle next HTTP request on connection with chained completion handlers
         void handleRequest();
     };
 
 private:
     Logger m_logger;
     Config::Pointer m_config;
+    RequestLog::Pointer m_requestLog;
     Controller::Pointer m_controller;
+    StateCache::Pointer m_stateCache;
+    Routes m_routes;
+    Statistics::Pointer m_statistics;
+    ConnectionPool m_pool;  // Declared before I/O context, so that connections held by its handlers go first
     boost::asio::io_context m_context;
+    RelayEvents::Pointer m_events;
+    ControlServer::Pointer m_control;
+    Scheduler::Pointer m_scheduler;
+    Strand m_controllerStrand;
     asio::ip::tcp::acceptor m_acceptor;
-    asio::ip::tcp::socket m_socket;
+    asio::steady_timer m_acceptRetry;
+    asio::ip::tcp::endpoint m_peer;
+    std::unique_ptr<Connection> m_accepting;
+    std::chrono::steady_clock::time_point m_launched;
+    bool m_accepted;
 
     /// @brief Start accepting client connections
     void startAccepting();
@@ -128,10 +543,20 @@ public:
     /// @brief Initialize HTTP server
     /// @param config Initialized config
     /// @param controller Relay controller
-    HttpServer(Config::Pointer config, Controller::Pointer controller);
+    /// @param listeners Listening sockets to take configured ports' sockets from
+    /// @throw std::runtime_error if sockets couldn't be opened
+    HttpServer(Config::Pointer config, Controller::Pointer controller, Listeners& listeners);
+
+    /// @brief Destroy pooled connections while the I/O context they belong to still exists
+    ~HttpServer();
+
+    /// @brief Start accepting connections
+    /// @param launched Time Loraine was launched at, startup time and time to the first connection are reported from it
+    /// @throw std::exception if a handler throws in any of the worker threads
+    void start(std::chrono::steady_clock::time_point launched = std::chrono::steady_clock::now());
 
-    /// @brief Start listening for connections
-    void start();
+    /// @brief Stop server, making start() return
+    void stop();
 };
 
 } // namespace kc
@@ -1,16 +1,26 @@
 #pragma once
 
 // STL modules
+#include <memory>
 #include <string>
 #include <vector>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
 #include <stdexcept>
 
 // UNIX modules
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
 
+#ifdef LORAINE_WIRINGPI
 // Library WiringPi
 #include <wiringPiI2C.h>
+#endif
 
 // Library {fmt}
 #include <fmt/format.h>
@@ -19,33 +29,176 @@ namespace kc {
 
 namespace I2C
 {
+    enum class Backend
+    {
+        WiringPi,   // Communicate through WiringPi library
+        Linux,      // Communicate through Linux i2c-dev interface
+        Simulated,  // Communicate with in-process simulated PCF8574-style board
+    };
+
+    struct Simulation
+    {
+        std::chrono::microseconds latency;  // Time every transaction takes
+        double failureRate;                 // Probability of a transaction to fail
+        double driftRate;                   // Probability of device outputs to change by themselves before a read
+    };
+
     class Device
     {
-    private:
+    public:
+        // Unique device instance pointer
+        using Pointer = std::unique_ptr<Device>;
+
+    protected:
         std::string m_port;
         uint8_t m_address;
-        int m_fd;
 
-    public:
-        /// @brief Initialize communication with I2C device
+    protected:
+        /// @brief Initialize device
         /// @param port I2C port to use
         /// @param address I2C device address
-        /// @throw std::runtime_error if internal error occurs
         Device(const std::string& port, uint8_t address);
 
-        ~Device();
+    public:
+        virtual ~Device() = default;
+
+        /// @brief Get I2C port
+        /// @return I2C port
+        inline const std::string& port() const
+        {
+            return m_port;
+        }
+
+        /// @brief Get I2C device address
+        /// @return I2C device address
+        inline uint8_t address() const
+        {
+            return m_address;
+        }
 
         /// @brief Send data to I2C device
         /// @param data Data to send
         /// @throw std::runtime_error if internal error occurs
         void send(const std::vector<uint8_t>& data);
 
+        /// @brief Send data to I2C device
+        /// @param data Data to send
+        /// @param length Length of data to send
+        /// @throw std::runtime_error if internal error occurs or not all data was sent
+        virtual void send(const uint8_t* data, size_t length) = 0;
+
         /// @brief Receive data from I2C device
         /// @param length Length of data to receive
         /// @throw std::runtime_error if internal error occurs
         /// @return Received data
         std::vector<uint8_t> receive(int length);
+
+        /// @brief Receive data from I2C device
+        /// @param data Buffer to receive data into
+        /// @param length Length of data to receive
+        /// @throw std::runtime_error if internal error occurs or not all data was received
+        virtual void receive(uint8_t* data, size_t length) = 0;
     };
+
+    class FileDevice : public Device
+    {
+    protected:
+        int m_fd;
+
+    protected:
+        /// @brief Initialize device communicating through file descriptor
+        /// @param port I2C port to use
+        /// @param address I2C device address
+        FileDevice(const std::string& port, uint8_t address);
+
+    public:
+        ~FileDevice();
+
+        /// @brief Send data to I2C device
+        /// @param data Data to send
+        /// @param length Length of data to send
+        /// @throw std::runtime_error if internal error occurs
+        void send(const uint8_t* data, size_t length) override;
+
+        /// @brief Receive data from I2C device
+        /// @param data Buffer to receive data into
+        /// @param length Length of data to receive
+        /// @throw std::runtime_error if internal error occurs
+        void receive(uint8_t* data, size_t length) override;
+    };
+
+    class WiringPiDevice : public FileDevice
+    {
+    public:
+        /// @brief Initialize communication with I2C device through WiringPi
+        /// @param port I2C port to use
+        /// @param address I2C device address
+        /// @throw std::runtime_error if internal error occurs
+        WiringPiDevice(const std::string& port, uint8_t address);
+    };
+
+    class LinuxDevice : public FileDevice
+    {
+    public:
+        /// @brief Initialize communication with I2C device through Linux i2c-dev interface
+        /// @param port I2C port to use
+        /// @param address I2C device address
+        /// @throw std::runtime_error if internal error occurs
+        LinuxDevice(const std::string& port, uint8_t address);
+    };
+
+    class SimulatedDevice : public Device
+    {
+    private:
+        Simulation m_simulation;
+        std::mutex m_mutex;
+        std::vector<uint8_t> m_latch;
+
+    private:
+        /// @brief Simulate transaction latency and failure
+        /// @param function Name of function performing the transaction
+        /// @throw std::runtime_error if transaction is simulated to fail
+        void transaction(const char* function);
+
+    public:
+        /// @brief Initialize simulated PCF8574/PCF8575-style I2C device
+        /// @param port I2C port to simulate
+        /// @param address I2C device address to simulate
+        /// @param simulation Simulation parameters
+        SimulatedDevice(const std::string& port, uint8_t address, const Simulation& simulation);
+
+        /// @brief Send data to simulated device: sent bytes are latched to device's outputs
+        /// @param data Data to send
+        /// @param length Length of data to send
+        /// @throw std::runtime_error if transaction is simulated to fail
+        void send(const uint8_t* data, size_t length) override;
+
+        /// @brief Receive data from simulated device: latched bytes are read back in the order they were sent, repeating
+        /// @param data Buffer to receive data into
+        /// @param length Length of data to receive
+        /// @throw std::runtime_error if transaction is simulated to fail
+        void receive(uint8_t* data, size_t length) override;
+    };
+
+    /// @brief Parse I2C backend name
+    /// @param name Backend name
+    /// @throw std::invalid_argument if backend is unknown
+    /// @return Parsed backend
+    Backend ParseBackend(const std::string& name);
+
+    /// @brief Get I2C backend name
+    /// @param backend Backend whose name to get
+    /// @return Backend name
+    const char* BackendName(Backend backend);
+
+    /// @brief Initialize communication with I2C device
+    /// @param backend Backend to communicate through
+    /// @param port I2C port to use
+    /// @param address I2C device address
+    /// @param simulation Simulation parameters, used only by simulated backend
+    /// @throw std::runtime_error if internal error occurs
+    /// @return Initialized device
+    Device::Pointer Open(Backend backend, const std::string& port, uint8_t address, const Simulation& simulation = {});
 }
 
 } // namespace kc
@@ -0,0 +1,151 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <string>
+#include <optional>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+// POSIX modules
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Library spdlog
+#include <spdlog/spdlog.h>
+
+// Custom modules
+#include "metrics.hpp"
+#include "relay_set.hpp"
+#include "utility.hpp"
+
+namespace kc {
+
+/*
+*   Append-only relays state journal kept in a memory-mapped file.
+*   Every state change appends a record per changed 64-relay word, which is a copy to the mapping without system calls.
+*   Records of a change are committed by a flag on the last one, so a change torn by a crash is dropped on restore.
+*   A full journal is compacted by writing the current state to a new file that atomically replaces the old one.
+*
+*   File:   | magic: 4 | format: 4 | relays: 4 | reserved: 4 | record... |
+*   Record: | version: 8 | bits: 8 | word: 2 | flags: 1 | reserved: 1 | checksum: 4 |
+*/
+class Journal
+{
+public:
+    // Unique journal instance pointer
+    using Pointer = std::unique_ptr<Journal>;
+
+    struct State
+    {
+        uint64_t version;
+        RelaySet mask;
+    };
+
+private:
+    // Shared journal logger instance pointer
+    using Logger = std::shared_ptr<spdlog::logger>;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t format;
+        uint32_t relays;
+        uint32_t reserved;
+    };
+
+    struct Record
+    {
+        uint64_t version;
+        uint64_t bits;
+        uint16_t word;
+        uint8_t flags;
+        uint8_t reserved;
+        uint32_t checksum;
+    };
+
+    static_assert(sizeof(Header) == 16 && sizeof(Record) == 24, "Journal layout must not be padded");
+
+    // Journal file format version
+    static constexpr uint32_t Format = 1;
+
+    // Record flag: the record is the last one of a state change
+    static constexpr uint8_t LastFlag = 0x01;
+
+    enum Counter
+    {
+        Records,
+        Compactions,
+        Failures,
+        CountersCount,
+    };
+
+private:
+    /// @brief Calculate record checksum
+    /// @param record Record whose checksum to calculate
+    /// @return Checksum of all record fields before the checksum
+    static uint32_t Checksum(const Record& record);
+
+private:
+    Logger m_logger;
+    std::string m_path;
+    size_t m_size;
+    size_t m_relays;
+    size_t m_words;
+    int m_fd;
+    uint8_t* m_map;
+    size_t m_mapSize;
+    size_t m_position;
+    bool m_failed;
+    std::optional<State> m_restored;
+    Metrics::CounterSet m_counters;
+
+private:
+    /// @brief Replay records of mapped journal
+    /// @return Last committed state or std::nullopt if journal has no committed state
+    std::optional<State> replay();
+
+    /// @brief Write record at current position and advance it
+    /// @param record Record to write, its checksum is filled in
+    void write(Record record);
+
+    /// @brief Replace journal with a new one holding only the given state
+    /// @param state State to write
+    /// @return True if journal was replaced
+    bool compact(const State& state);
+
+public:
+    /// @brief Open journal, creating it if it doesn't exist, and restore the last state recorded in it
+    /// @param path Journal file path
+    /// @param size Journal file size in bytes
+    /// @param relays Count of relays
+    /// @throw std::runtime_error if journal couldn't be opened or created
+    Journal(const std::string& path, size_t size, size_t relays);
+
+    ~Journal();
+
+    /// @brief Get state restored from journal when it was opened
+    /// @return Restored state or std::nullopt if journal had no state of the same relays
+    inline const std::optional<State>& restored() const
+    {
+        return m_restored;
+    }
+
+    /// @brief Record state change, compacting journal if it's full. Calls must be serialized.
+    /// @param version Version of new state
+    /// @param previous State before the change
+    /// @param next State after the change
+    void append(uint64_t version, const RelaySet& previous, const RelaySet& next);
+
+    /// @brief Write journal metrics in Prometheus text format
+    /// @param metrics String to append to
+    void writeMetrics(std::string& metrics) const;
+};
+
+} // namespace kc
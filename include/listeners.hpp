@@ -0,0 +1,104 @@
+#pragma once
+
+// STL modules
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+// POSIX modules
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Boost libraries
+#include <boost/asio.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Library spdlog
+#include <spdlog/spdlog.h>
+
+// Custom modules
+#include "config.hpp"
+#include "utility.hpp"
+
+namespace kc {
+
+/*
+*   Listening sockets of configured ports, brought up before anything else so that clients
+*   connecting while Loraine starts are queued by the kernel instead of being refused.
+*   Sockets passed by the service manager (systemd socket activation, LISTEN_FDS) are used when
+*   they match a configured port. They stay open across restarts, so connections are never refused.
+*/
+class Listeners
+{
+private:
+    struct Listener
+    {
+        int fd;
+        int type;           // SOCK_STREAM or SOCK_DGRAM
+        int family;         // AF_INET or AF_INET6
+        uint16_t port;      // Zero if the socket can't be used
+    };
+
+    // First file descriptor passed by the service manager
+    static constexpr int ListenFdsStart = 3;
+
+    // Count of pending connections the kernel queues for a listening socket
+    static constexpr int Backlog = SOMAXCONN;
+
+private:
+    /// @brief Take sockets passed by the service manager
+    /// @return Passed sockets, empty if Loraine wasn't socket-activated
+    static std::vector<Listener> Inherit();
+
+    /// @brief Bind new socket to port on all interfaces
+    /// @param type Socket type, SOCK_STREAM or SOCK_DGRAM
+    /// @param port Port to bind to
+    /// @throw std::runtime_error if socket couldn't be bound
+    /// @return Bound socket, listening if it is a stream socket
+    static Listener Bind(int type, uint16_t port);
+
+private:
+    std::vector<Listener> m_listeners;
+
+private:
+    /// @brief Take socket out of the set, binding one if the set has none
+    /// @param type Socket type, SOCK_STREAM or SOCK_DGRAM
+    /// @param port Port of socket to take
+    /// @throw std::runtime_error if socket couldn't be bound
+    /// @return Taken socket, its descriptor is owned by the caller
+    Listener take(int type, uint16_t port);
+
+public:
+    /// @brief Take sockets passed by the service manager and bind sockets of configured ports that weren't passed
+    /// @param config Initialized config
+    /// @throw std::runtime_error if a socket couldn't be bound
+    Listeners(const Config& config);
+
+    Listeners(const Listeners& other) = delete;
+
+    /// @brief Close sockets that weren't taken
+    ~Listeners();
+
+    /// @brief Take TCP listening socket of port
+    /// @param context Context to handle socket's operations in
+    /// @param port Port the socket listens on
+    /// @throw std::runtime_error if socket couldn't be bound
+    /// @return Acceptor of the socket
+    boost::asio::ip::tcp::acceptor acceptor(boost::asio::io_context& context, uint16_t port);
+
+    /// @brief Take UDP socket of port
+    /// @param context Context to handle socket's operations in
+    /// @param port Port the socket is bound to
+    /// @throw std::runtime_error if socket couldn't be bound
+    /// @return The socket
+    boost::asio::ip::udp::socket datagramSocket(boost::asio::io_context& context, uint16_t port);
+};
+
+} // namespace kc
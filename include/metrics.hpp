@@ -0,0 +1,120 @@
+#pragma once
+
+// STL modules
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iterator>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+namespace kc {
+
+namespace Metrics
+{
+    // Count of shards metric values are split into
+    constexpr size_t Shards = 16;
+
+    // Upper bounds of histogram buckets in microseconds, the +Inf bucket is implicit
+    constexpr uint64_t Buckets[] = { 50, 100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 500'000, 1'000'000 };
+
+    // Count of histogram buckets including the +Inf bucket
+    constexpr size_t BucketsCount = std::size(Buckets) + 1;
+
+    /*
+    *   Every thread increments values in its own shard, so hot path updates are
+    *   relaxed atomic additions to cache lines no other thread writes to.
+    *   Shards are summed only when metrics are scraped.
+    */
+    class CounterSet
+    {
+    private:
+        struct alignas(64) Line
+        {
+            std::atomic<uint64_t> values[8];
+
+            Line();
+        };
+
+    private:
+        /// @brief Get shard of calling thread
+        /// @return Calling thread's shard
+        static size_t Shard();
+
+    private:
+        size_t m_size;
+        size_t m_lines;
+        std::vector<Line> m_shards;
+
+    public:
+        /// @brief Initialize counter set
+        /// @param size Count of counters in set
+        CounterSet(size_t size);
+
+        /// @brief Get count of counters in set
+        /// @return Count of counters in set
+        inline size_t size() const
+        {
+            return m_size;
+        }
+
+        /// @brief Add to counter
+        /// @param index Index of counter to add to
+        /// @param value Value to add
+        inline void add(size_t index, uint64_t value = 1)
+        {
+            m_shards[Shard() * m_lines + index / 8].values[index % 8].fetch_add(value, std::memory_order_relaxed);
+        }
+
+        /// @brief Get counter value
+        /// @param index Index of counter whose value to get
+        /// @return Counter value
+        uint64_t value(size_t index) const;
+    };
+
+    class HistogramSet
+    {
+    private:
+        // Every histogram consists of bucket counters followed by sum of observed durations in microseconds
+        static constexpr size_t Stride = BucketsCount + 1;
+
+    private:
+        CounterSet m_counters;
+
+    public:
+        /// @brief Initialize histogram set
+        /// @param size Count of histograms in set
+        HistogramSet(size_t size);
+
+        /// @brief Get count of histograms in set
+        /// @return Count of histograms in set
+        inline size_t size() const
+        {
+            return m_counters.size() / Stride;
+        }
+
+        /// @brief Observe duration
+        /// @param index Index of histogram to observe duration in
+        /// @param duration Observed duration
+        void observe(size_t index, std::chrono::nanoseconds duration);
+
+        /// @brief Write histograms in Prometheus text format
+        /// @param metrics String to append to
+        /// @param name Metric name
+        /// @param help Metric description
+        /// @param label Label distinguishing histograms
+        /// @param values Label value of every histogram
+        void write(std::string& metrics, const char* name, const char* help, const char* label, const std::vector<std::string>& values) const;
+    };
+
+    /// @brief Write metric header in Prometheus text format
+    /// @param metrics String to append to
+    /// @param name Metric name
+    /// @param help Metric description
+    /// @param type Metric type
+    void WriteHeader(std::string& metrics, const char* name, const char* help, const char* type);
+}
+
+} // namespace kc
@@ -0,0 +1,182 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <utility>
+
+// Library spdlog
+#include <spdlog/spdlog.h>
+
+// Custom modules
+#include "i2c.hpp"
+#include "metrics.hpp"
+#include "utility.hpp"
+
+namespace kc {
+
+/*
+*   Driver states are written by one worker per I2C bus, so buses are driven concurrently
+*   and a state change spanning many buses takes about as long as its slowest bus.
+*   Workers periodically read driver states back and rewrite drivers whose outputs drifted from them.
+*/
+class OutputStage
+{
+public:
+    struct Driver
+    {
+        I2C::Device::Pointer device;
+        size_t width;   // Count of state bytes written to the device
+    };
+
+    // Function called with whether or not drivers were written successfully, must return without blocking
+    using Completion = std::function<void(bool)>;
+
+private:
+    // Shared output stage logger instance pointer
+    using Logger = std::shared_ptr<spdlog::logger>;
+
+    struct Output
+    {
+        I2C::Device::Pointer device;
+        size_t offset;      // Offset of device's state in submitted states
+        size_t busOffset;   // Offset of device's state in its bus's buffers
+        size_t width;
+        bool valid;
+    };
+
+    struct Waiter
+    {
+        size_t pending;         // Count of buses that haven't written their target states yet
+        bool success;
+        Completion completion;
+    };
+
+    /*
+    *   Submissions are handed to a bus worker through a triple buffer: the submitter fills its own buffer
+    *   and atomically swaps it with the shared one, the worker swaps the shared one with its own once it's newer.
+    *   Neither side ever blocks the other, and a worker that falls behind only gets the latest states.
+    */
+    struct Bus
+    {
+        std::string port;
+        std::vector<size_t> outputs;                // Indices of bus's outputs
+        std::array<std::vector<uint8_t>, 3> states;
+        std::vector<uint8_t> submitted;             // States last handed to the worker, owned by submitters
+        std::vector<uint8_t> written;               // States last written to devices, owned by the worker
+        std::vector<uint8_t> readBack;              // States last read back from devices, owned by the worker
+        size_t back;                                // Index of submitters' buffer
+        std::atomic<uint64_t> shared;               // Index of shared buffer, flags and sequence number of its states
+        std::atomic<uint64_t> requested;            // Sequence number of the latest submission handed to the worker
+        std::atomic<uint64_t> acked;                // Sequence number of the latest written submission and failure bit
+        std::vector<std::pair<uint64_t, std::shared_ptr<Waiter>>> waiters;  // Target sequence numbers of waiters, guarded by wait lock
+        std::thread thread;
+    };
+
+    // Layout of shared buffer word: | sequence number | verify flag | stop flag | force flag | buffer index: 2 |
+    static constexpr uint64_t IndexMask = 0b00011;
+    static constexpr uint64_t ForceFlag = 0b00100;
+    static constexpr uint64_t StopFlag = 0b01000;
+    static constexpr uint64_t VerifyFlag = 0b10000;
+    static constexpr int SequenceShift = 5;
+
+    // Layout of acknowledgement word: | sequence number | failure bit |
+    static constexpr uint64_t FailedFlag = 0b1;
+    static constexpr int AckShift = 1;
+
+private:
+    Logger m_logger;
+    std::chrono::microseconds m_window;
+    std::vector<Output> m_outputs;
+    std::vector<std::unique_ptr<Bus>> m_buses;
+    Metrics::CounterSet m_writes;
+    Metrics::HistogramSet m_writeDurations;
+    Metrics::CounterSet m_verifications;
+    std::mutex m_mutex;
+    std::atomic<uint64_t> m_submitted;
+    std::mutex m_waitMutex;
+    std::chrono::milliseconds m_verifyInterval;
+    std::mutex m_verifyMutex;
+    std::condition_variable m_verifyCondition;
+    bool m_verifyStop;
+    std::thread m_verifyThread;
+
+private:
+    /// @brief Write states submitted to bus until stopped
+    /// @param bus Bus to write states of
+    void run(Bus& bus);
+
+    /// @brief Write states to bus's output
+    /// @param bus Bus of the output
+    /// @param index Index of output to write
+    /// @param states States of all bus's outputs
+    /// @return True if output was written successfully
+    bool write(Bus& bus, size_t index, const std::vector<uint8_t>& states);
+
+    /// @brief Report outcome of bus's write to waiters whose target states it wrote
+    /// @param bus Bus that wrote states
+    /// @param sequence Sequence number of written submission
+    /// @param success Whether or not all outputs were written successfully
+    void complete(Bus& bus, uint64_t sequence, bool success);
+
+    /// @brief Read states of bus's outputs back, rewriting outputs that drifted from written states or failed to be written
+    /// @param bus Bus to verify
+    /// @param states States of all bus's outputs the worker took last
+    void verify(Bus& bus, const std::vector<uint8_t>& states);
+
+    /// @brief Request verification from every bus worker once per verify interval until stopped
+    void runVerification();
+
+public:
+    /// @brief Initialize output stage and start a worker thread for every bus
+    /// @param drivers Driver devices
+    /// @param window Time to coalesce submitted states for before writing them
+    /// @param verifyInterval Interval of reading driver states back, zero disables read-back
+    OutputStage(std::vector<Driver> drivers, std::chrono::microseconds window, std::chrono::milliseconds verifyInterval);
+
+    /// @brief Write remaining submitted states and stop bus worker threads
+    ~OutputStage();
+
+    /// @brief Submit driver states to be written
+    /// @param states States of all drivers one after another, in order of devices
+    /// @param force Whether or not to write states even if drivers are known to be in them already
+    /// @return Submission sequence number
+    uint64_t submit(const uint8_t* states, bool force = false);
+
+    /// @brief Get sequence number of the latest submission
+    /// @return Latest submission sequence number
+    uint64_t submitted();
+
+    /*
+    *   Every bus reports the outcome of the write that took the submission's states or newer ones replacing them.
+    *   A bus that had already written newer states when the wait started reports its latest write instead,
+    *   outcomes of earlier writes aren't kept.
+    */
+
+    /// @brief Call completion once submission is written by every bus it changed
+    /// @param sequence Submission sequence number
+    /// @param completion Completion to call, it's called under a lock shared by all waits,
+    /// after completions of earlier waits for the same or earlier submissions
+    void wait(uint64_t sequence, Completion completion);
+
+    /// @brief Wait until submission is written by every bus it changed
+    /// @param sequence Submission sequence number
+    /// @return True if all drivers were written successfully
+    bool wait(uint64_t sequence);
+
+    /// @brief Write output stage metrics in Prometheus text format
+    /// @param metrics String to append to
+    void writeMetrics(std::string& metrics) const;
+};
+
+} // namespace kc
@@ -0,0 +1,147 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <utility>
+
+// Boost libraries
+#include <boost/asio.hpp>
+#include <boost/core/ignore_unused.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Custom modules
+#include "config.hpp"
+#include "controller.hpp"
+#include "metrics.hpp"
+#include "state_cache.hpp"
+
+namespace kc {
+
+/* Namespace aliases and imports */
+namespace asio = boost::asio;
+
+/*
+*   Relay state changes are streamed to subscribers as Server-Sent Events.
+*   Controller only sets a flag and, if it wasn't set yet, posts a single fan-out handler,
+*   so mutations never wait for subscribers no matter how many there are or how slow they are.
+*/
+class RelayEvents : public std::enable_shared_from_this<RelayEvents>
+{
+public:
+    // Shared relay events instance pointer
+    using Pointer = std::shared_ptr<RelayEvents>;
+
+    // Strand that serializes handlers of a single connection
+    using Strand = asio::strand<asio::io_context::executor_type>;
+
+    // Connection socket bound to its strand: a concrete executor type isn't type-erased, so it is copied without allocations
+    using Socket = asio::basic_stream_socket<asio::ip::tcp, Strand>;
+
+    // Timer bound to connection's strand
+    using Timer = asio::basic_waitable_timer<std::chrono::steady_clock, asio::wait_traits<std::chrono::steady_clock>, Strand>;
+
+private:
+    class Subscriber : public std::enable_shared_from_this<Subscriber>
+    {
+    private:
+        RelayEvents::Pointer m_events;
+        Socket m_socket;
+        Timer m_heartbeat;
+        std::array<char, 512> m_readBuffer;
+        std::deque<Controller::Snapshot> m_queue;
+        Controller::Snapshot m_sent;
+        std::string m_message;
+        bool m_writing;
+
+    private:
+        /// @brief Receive and discard client data until connection is closed
+        void receive();
+
+        /// @brief Send heartbeat comment when connection was idle for a while
+        void heartbeat();
+
+        /// @brief Queue state snapshot, coalescing queued snapshots if queue is full
+        /// @param snapshot Snapshot to queue
+        void enqueue(Controller::Snapshot snapshot);
+
+        /// @brief Send next queued state change if no message is being sent
+        void send();
+
+        /// @brief Send prepared message
+        void write();
+
+        /// @brief Close connection
+        void close();
+
+    public:
+        /// @brief Initialize subscriber
+        /// @param events Relay events
+        /// @param socket Subscriber connection socket
+        Subscriber(RelayEvents::Pointer events, Socket&& socket);
+
+        ~Subscriber();
+
+        /// @brief Send response header and initial state
+        /// @param version HTTP version of subscription request
+        /// @param snapshot Initial state snapshot
+        void start(unsigned version, Controller::Snapshot snapshot);
+
+        /// @brief Push state snapshot to subscriber
+        /// @param snapshot Pushed snapshot
+        void push(Controller::Snapshot snapshot);
+    };
+
+    enum Counter
+    {
+        Subscribed,
+        Unsubscribed,
+        Sent,
+        Coalesced,
+        CountersCount,
+    };
+
+private:
+    Config::Pointer m_config;
+    Controller::Pointer m_controller;
+    asio::io_context& m_context;
+    std::atomic<bool> m_pending;
+    std::mutex m_mutex;
+    std::vector<std::weak_ptr<Subscriber>> m_subscribers;
+    Metrics::CounterSet m_counters;
+
+private:
+    /// @brief Handle controller state change notification
+    void notify();
+
+    /// @brief Push current state to all subscribers
+    void dispatch();
+
+public:
+    /// @brief Initialize relay events and start listening for controller state changes
+    /// @param config Initialized config
+    /// @param controller Relay controller
+    /// @param context Context to dispatch events in, must not run after relay events are destroyed
+    RelayEvents(Config::Pointer config, Controller::Pointer controller, asio::io_context& context);
+
+    ~RelayEvents();
+
+    /// @brief Start streaming relay state changes to client
+    /// @param version HTTP version of subscription request
+    /// @param socket Client connection socket, must be called in its executor
+    void subscribe(unsigned version, Socket&& socket);
+
+    /// @brief Write relay events metrics in Prometheus text format
+    /// @param metrics String to append to
+    void writeMetrics(std::string& metrics) const;
+};
+
+} // namespace kc
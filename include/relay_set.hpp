@@ -0,0 +1,213 @@
+#pragma once
+
+// STL modules
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+namespace kc {
+
+/*
+*   Set of relays: bit N is set when relay N is in the set.
+*   Count of relays is known only once the configured boards are read, but the bits are stored inline
+*   up to MaxRelays, so copying a set never allocates and snapshots stay cheap to pass around.
+*/
+class RelaySet
+{
+public:
+    // Maximum count of relays a set can hold
+    static constexpr size_t MaxRelays = 1024;
+
+    // Count of bits in a single storage word
+    static constexpr size_t WordBits = 64;
+
+    // Count of storage words
+    static constexpr size_t Words = MaxRelays / WordBits;
+
+private:
+    std::array<uint64_t, Words> m_words;
+
+public:
+    /// @brief Get set of consecutive relays
+    /// @param first First relay in set
+    /// @param count Count of relays in set
+    /// @return Set of relays from first to first + count - 1
+    static constexpr RelaySet Range(size_t first, size_t count)
+    {
+        RelaySet set;
+        for (size_t relay = first; relay < first + count && relay < MaxRelays; ++relay)
+            set.set(relay);
+        return set;
+    }
+
+    /// @brief Get set from integer bits
+    /// @param bits Bits of relays, bit N stands for relay offset + N
+    /// @param offset Relay that the lowest bit stands for
+    /// @return Set of relays whose bits are set, relays past MaxRelays are dropped
+    static constexpr RelaySet FromBits(uint64_t bits, size_t offset = 0)
+    {
+        RelaySet set;
+        for (; bits != 0; bits &= bits - 1)
+        {
+            size_t relay = offset + std::countr_zero(bits);
+            if (relay < MaxRelays)
+                set.set(relay);
+        }
+        return set;
+    }
+
+public:
+    constexpr RelaySet()
+        : m_words{}
+    {}
+
+    /// @brief Check if relay is in set
+    /// @param relay Relay to check
+    /// @return True if relay is in set
+    constexpr bool test(size_t relay) const
+    {
+        return (m_words[relay / WordBits] >> (relay % WordBits)) & 1;
+    }
+
+    /// @brief Add relay to set or remove it from set
+    /// @param relay Relay to add or remove
+    /// @param value Whether to add or to remove the relay
+    constexpr void set(size_t relay, bool value = true)
+    {
+        uint64_t bit = uint64_t(1) << (relay % WordBits);
+        if (value)
+            m_words[relay / WordBits] |= bit;
+        else
+            m_words[relay / WordBits] &= ~bit;
+    }
+
+    /// @brief Remove relay from set
+    /// @param relay Relay to remove
+    constexpr void reset(size_t relay)
+    {
+        set(relay, false);
+    }
+
+    /// @brief Get bits of consecutive relays
+    /// @param first First relay whose bit to get
+    /// @param count Count of bits to get, at most WordBits
+    /// @return Bits of relays, bit N stands for relay first + N
+    constexpr uint64_t bits(size_t first, size_t count) const
+    {
+        if (count == 0 || first >= MaxRelays)
+            return 0;
+
+        size_t word = first / WordBits, shift = first % WordBits;
+        uint64_t bits = m_words[word] >> shift;
+        if (shift != 0 && word + 1 < Words)
+            bits |= m_words[word + 1] << (WordBits - shift);
+        return count < WordBits ? bits & ((uint64_t(1) << count) - 1) : bits;
+    }
+
+    /// @brief Get storage word
+    /// @param index Index of word to get
+    /// @return Storage word, bit N stands for relay index * WordBits + N
+    constexpr uint64_t word(size_t index) const
+    {
+        return m_words[index];
+    }
+
+    /// @brief Set storage word
+    /// @param index Index of word to set
+    /// @param value New word value, bit N stands for relay index * WordBits + N
+    constexpr void setWord(size_t index, uint64_t value)
+    {
+        m_words[index] = value;
+    }
+
+    /// @brief Check if set is not empty
+    /// @return True if at least one relay is in set
+    constexpr bool any() const
+    {
+        for (uint64_t word : m_words)
+        {
+            if (word != 0)
+                return true;
+        }
+        return false;
+    }
+
+    /// @brief Check if set is empty
+    /// @return True if no relay is in set
+    constexpr bool none() const
+    {
+        return !any();
+    }
+
+    /// @brief Get count of relays in set
+    /// @return Count of relays in set
+    constexpr size_t count() const
+    {
+        size_t count = 0;
+        for (uint64_t word : m_words)
+            count += std::popcount(word);
+        return count;
+    }
+
+    /// @brief Call function for every relay in set in ascending order
+    /// @param function Function to call with relay
+    template <typename Function>
+    constexpr void forEach(Function function) const
+    {
+        for (size_t index = 0; index < Words; ++index)
+        {
+            for (uint64_t word = m_words[index]; word != 0; word &= word - 1)
+                function(index * WordBits + std::countr_zero(word));
+        }
+    }
+
+    constexpr RelaySet& operator&=(const RelaySet& other)
+    {
+        for (size_t index = 0; index < Words; ++index)
+            m_words[index] &= other.m_words[index];
+        return *this;
+    }
+
+    constexpr RelaySet& operator|=(const RelaySet& other)
+    {
+        for (size_t index = 0; index < Words; ++index)
+            m_words[index] |= other.m_words[index];
+        return *this;
+    }
+
+    constexpr RelaySet& operator^=(const RelaySet& other)
+    {
+        for (size_t index = 0; index < Words; ++index)
+            m_words[index] ^= other.m_words[index];
+        return *this;
+    }
+
+    // Complement covers all MaxRelays relays, not only configured ones
+    constexpr RelaySet operator~() const
+    {
+        RelaySet set;
+        for (size_t index = 0; index < Words; ++index)
+            set.m_words[index] = ~m_words[index];
+        return set;
+    }
+
+    friend constexpr RelaySet operator&(RelaySet left, const RelaySet& right)
+    {
+        return left &= right;
+    }
+
+    friend constexpr RelaySet operator|(RelaySet left, const RelaySet& right)
+    {
+        return left |= right;
+    }
+
+    friend constexpr RelaySet operator^(RelaySet left, const RelaySet& right)
+    {
+        return left ^= right;
+    }
+
+    friend constexpr bool operator==(const RelaySet& left, const RelaySet& right) = default;
+};
+
+} // namespace kc
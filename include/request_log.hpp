@@ -0,0 +1,135 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <bit>
+
+// Boost libraries
+#include <boost/asio/ip/address.hpp>
+#include <boost/beast/http/verb.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Library spdlog
+#include <spdlog/spdlog.h>
+
+// Custom modules
+#include "config.hpp"
+#include "metrics.hpp"
+
+namespace kc {
+
+/* Namespace aliases and imports */
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+
+/*
+*   Request log lines are captured as fixed-size records and pushed to a bounded lock-free queue.
+*   A background thread formats records and writes them to sinks,
+*   so request handling never waits for terminal or journald.
+*/
+class RequestLog
+{
+public:
+    // Shared request log instance pointer
+    using Pointer = std::shared_ptr<RequestLog>;
+
+    // Shared logger instance pointer
+    using Logger = std::shared_ptr<spdlog::logger>;
+
+    // Count of target characters kept in a record, longer targets are truncated
+    static constexpr size_t TargetCapacity = 96;
+
+private:
+    struct Record
+    {
+        spdlog::log_clock::time_point time;
+        spdlog::level::level_enum level;
+        beast::http::verb method;
+        unsigned status;
+        asio::ip::address address;
+        const char* message;
+        size_t targetLength;
+        bool targetTruncated;
+        char target[TargetCapacity];
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> sequence;
+        Record record;
+    };
+
+    enum Counter
+    {
+        Written,
+        Dropped,
+        CountersCount,
+    };
+
+private:
+    Logger m_logger;
+    bool m_async;
+    Config::LogOverflow m_overflow;
+    std::vector<Slot> m_slots;
+    uint64_t m_mask;
+    alignas(64) std::atomic<uint64_t> m_head;
+    alignas(64) uint64_t m_tail;
+    std::atomic<uint32_t> m_signal;
+    std::atomic<bool> m_sleeping;
+    std::atomic<bool> m_running;
+    Metrics::CounterSet m_counters;
+    std::thread m_thread;
+
+private:
+    /// @brief Format record and write it to logger sinks
+    /// @param record Record to write
+    void write(const Record& record);
+
+    /// @brief Try to push record to queue
+    /// @param record Record to push
+    /// @return True if record was pushed, false if queue is full
+    bool push(const Record& record);
+
+    /// @brief Try to pop record from queue
+    /// @param record Record to pop into
+    /// @return True if record was popped, false if queue is empty
+    bool pop(Record& record);
+
+    /// @brief Wake background thread up if it is waiting for records
+    void wake();
+
+    /// @brief Write queued records until request log is destroyed
+    void run();
+
+public:
+    /// @brief Initialize request log
+    /// @param config Initialized config
+    /// @param logger Logger to write records to
+    RequestLog(Config::Pointer config, Logger logger);
+
+    ~RequestLog();
+
+    /// @brief Log handled request
+    /// @param level Record level
+    /// @param method Request method
+    /// @param target Request target
+    /// @param status Response status
+    /// @param address Client address
+    /// @param message Record message, must outlive request log
+    void log(spdlog::level::level_enum level, beast::http::verb method, std::string_view target, unsigned status, const asio::ip::address& address, const char* message);
+
+    /// @brief Write request log metrics in Prometheus text format
+    /// @param metrics String to append to
+    void writeMetrics(std::string& metrics) const;
+};
+
+} // namespace kc
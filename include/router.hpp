@@ -0,0 +1,154 @@
+#pragma once
+
+// STL modules
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+
+// Boost libraries
+#include <boost/beast/http/verb.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+namespace kc {
+
+/* Namespace aliases and imports */
+namespace beast = boost::beast;
+
+template <typename Handler>
+class Router
+{
+public:
+    enum class Status
+    {
+        Found,              // Handler for resource and method was found
+        NotFound,           // Resource is unknown
+        MethodNotAllowed,   // Resource is known, but doesn't handle the method
+    };
+
+    struct Match
+    {
+        Status status;
+        const Handler* handler;
+        size_t resource;    // Index of matched resource, equal to resources count if resource is unknown
+        std::string_view parameter; // Part of requested resource matched by wildcard of a prefix route
+    };
+
+private:
+    // Hash that allows looking up resources by std::string_view without constructing std::string
+    struct Hash
+    {
+        using is_transparent = void;
+
+        inline size_t operator()(std::string_view resource) const
+        {
+            return std::hash<std::string_view>()(resource);
+        }
+    };
+
+    struct Resource
+    {
+        size_t index;
+
+        // A resource handles only a few methods, a linear scan is faster than any lookup structure
+        std::vector<std::pair<beast::http::verb, Handler>> methods;
+    };
+
+private:
+    std::unordered_map<std::string, Resource, Hash, std::equal_to<>> m_resources;
+
+    /*
+    *   Resources ending with a trailing "/" followed by "*" match any single path segment in place of the wildcard.
+    *   They are only checked when no resource matches exactly, so exact routes stay a single lookup.
+    *   References to map elements aren't invalidated by rehashing.
+    */
+    std::vector<std::pair<std::string, const Resource*>> m_prefixes;
+
+private:
+    /// @brief Find handler of resource's method
+    /// @param resource Matched resource
+    /// @param method Requested method
+    /// @param parameter Part of requested resource matched by wildcard
+    /// @return Route match
+    static Match FindMethod(const Resource& resource, beast::http::verb method, std::string_view parameter)
+    {
+        for (const auto& entry : resource.methods)
+        {
+            if (entry.first == method)
+                return { Status::Found, &entry.second, resource.index, parameter };
+        }
+        return { Status::MethodNotAllowed, nullptr, resource.index, parameter };
+    }
+
+public:
+    /// @brief Get count of routed resources
+    /// @return Count of routed resources
+    inline size_t size() const
+    {
+        return m_resources.size();
+    }
+
+    /// @brief Get routed resources
+    /// @return Routed resources ordered by their indexes
+    std::vector<std::string> resources() const
+    {
+        std::vector<std::string> resources(m_resources.size());
+        for (const auto& entry : m_resources)
+            resources[entry.second.index] = entry.first;
+        return resources;
+    }
+
+    /// @brief Add route
+    /// @param resource Resource to route, resource ending with "/*" routes all resources with its prefix and a single segment after it
+    /// @param method Method to route
+    /// @param handler Handler of resource and method
+    /// @throw std::invalid_argument if route is already added
+    void add(std::string resource, beast::http::verb method, Handler handler)
+    {
+        auto [resourceEntry, inserted] = m_resources.try_emplace(std::move(resource), Resource{ m_resources.size(), {} });
+        if (inserted && resourceEntry->first.ends_with("/*"))
+            m_prefixes.emplace_back(resourceEntry->first.substr(0, resourceEntry->first.size() - 1), &resourceEntry->second);
+
+        auto& methods = resourceEntry->second.methods;
+        for (const auto& entry : methods)
+        {
+            if (entry.first == method)
+            {
+                throw std::invalid_argument(fmt::format(
+                    "kc::Router::add(): Route is already added [method: {}]",
+                    std::string(beast::http::to_string(method))
+                ));
+            }
+        }
+        methods.emplace_back(method, std::move(handler));
+    }
+
+    /// @brief Find route handler
+    /// @param resource Requested resource
+    /// @param method Requested method
+    /// @return Route match
+    Match find(std::string_view resource, beast::http::verb method) const
+    {
+        auto resourceEntry = m_resources.find(resource);
+        if (resourceEntry != m_resources.end())
+            return FindMethod(resourceEntry->second, method, {});
+
+        for (const auto& [prefix, prefixResource] : m_prefixes)
+        {
+            if (resource.size() > prefix.size() && resource.starts_with(prefix))
+            {
+                std::string_view parameter = resource.substr(prefix.size());
+                if (parameter.find('/') == std::string_view::npos)
+                    return FindMethod(*prefixResource, method, parameter);
+            }
+        }
+        return { Status::NotFound, nullptr, m_resources.size(), {} };
+    }
+};
+
+} // namespace kc
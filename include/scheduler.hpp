@@ -0,0 +1,148 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <stdexcept>
+
+// Boost libraries
+#include <boost/asio.hpp>
+#include <boost/core/ignore_unused.hpp>
+
+// Library {fmt}
+#include <fmt/format.h>
+
+// Custom modules
+#include "config.hpp"
+#include "controller.hpp"
+#include "metrics.hpp"
+#include "relay_events.hpp"
+
+namespace kc {
+
+/* Namespace aliases and imports */
+namespace asio = boost::asio;
+
+/*
+*   Relay state changes scheduled to happen once at a given time or repeatedly at a given interval.
+*   Pending jobs are ordered by a binary heap and the whole scheduler is driven by a single timer
+*   armed for the earliest deadline, so neither a pending job nor an expired one costs more than a heap operation.
+*/
+class Scheduler : public std::enable_shared_from_this<Scheduler>
+{
+public:
+    // Shared scheduler instance pointer
+    using Pointer = std::shared_ptr<Scheduler>;
+
+    // Clock jobs are scheduled with, immune to wall clock adjustments
+    using Clock = std::chrono::steady_clock;
+
+    struct Job
+    {
+        uint64_t id;
+        Controller::Mask mask;              // Relays changed by the job
+        Controller::Mask value;             // New state of relays in mask
+        Clock::time_point deadline;         // Time of the next run
+        std::chrono::milliseconds interval; // Time between runs, zero for a job that runs once
+        uint64_t runs;                      // Count of runs made so far
+    };
+
+    // Farthest a job's first run can be from now, and longest interval between its runs
+    static constexpr std::chrono::milliseconds MaxHorizon = std::chrono::hours(24 * 366);
+
+    // Shortest interval between runs of a recurring job
+    static constexpr std::chrono::milliseconds MinInterval = std::chrono::milliseconds(100);
+
+    // Result of adding a job
+    enum class AddResult
+    {
+        Added,      // Job was added
+        Full,       // Maximum count of pending jobs is reached
+    };
+
+private:
+    // Timer bound to scheduler's strand
+    using Timer = RelayEvents::Timer;
+
+    struct Entry
+    {
+        Clock::time_point deadline;
+        uint64_t id;
+
+        // Standard heap algorithms build a max-heap, so the entry with the earliest deadline compares greatest
+        inline bool operator<(const Entry& other) const
+        {
+            return deadline > other.deadline || (deadline == other.deadline && id > other.id);
+        }
+    };
+
+    enum Counter
+    {
+        Runs,
+        CountersCount,
+    };
+
+private:
+    Config::Pointer m_config;
+    Controller::Pointer m_controller;
+    Timer m_timer;
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, Job> m_jobs;
+    std::vector<Entry> m_heap;
+    std::vector<Job> m_due;
+    uint64_t m_nextId;
+    std::optional<Clock::time_point> m_armed;
+    Metrics::CounterSet m_counters;
+    Metrics::HistogramSet m_lateness;
+
+private:
+    /// @brief Arm timer for the earliest deadline if it isn't armed for it already, must be called in timer's executor
+    void arm();
+
+    /// @brief Run all jobs whose deadline has passed and rearm timer, must be called in timer's executor
+    void expire();
+
+public:
+    /// @brief Initialize scheduler
+    /// @param config Initialized config
+    /// @param controller Relay controller
+    /// @param context Context to run jobs in, must not run after scheduler is destroyed
+    Scheduler(Config::Pointer config, Controller::Pointer controller, asio::io_context& context);
+
+    /// @brief Schedule job
+    /// @param mask Relays changed by the job
+    /// @param value New state of relays in mask
+    /// @param deadline Time of the first run
+    /// @param interval Time between runs, zero for a job that runs once
+    /// @param job Added job
+    /// @throw std::invalid_argument if deadline is further than MaxHorizon from now or interval is out of range
+    /// @return Add result
+    AddResult add(const Controller::Mask& mask, const Controller::Mask& value, Clock::time_point deadline, std::chrono::milliseconds interval, Job& job);
+
+    /// @brief Cancel pending job
+    /// @param id ID of job to cancel
+    /// @return Cancelled job or std::nullopt if there is no pending job with this ID
+    std::optional<Job> remove(uint64_t id);
+
+    /// @brief Get pending job
+    /// @param id ID of job to get
+    /// @return Pending job or std::nullopt if there is no pending job with this ID
+    std::optional<Job> get(uint64_t id) const;
+
+    /// @brief Get all pending jobs
+    /// @return Pending jobs ordered by their IDs
+    std::vector<Job> jobs() const;
+
+    /// @brief Write scheduler metrics in Prometheus text format
+    /// @param metrics String to append to
+    void writeMetrics(std::string& metrics) const;
+};
+
+} // namespace kc
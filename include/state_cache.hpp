@@ -0,0 +1,63 @@
+#pragma once
+
+// STL modules
+#include <memory>
+#include <string>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+
+// Custom modules
+#include "controller.hpp"
+
+namespace kc {
+
+class StateCache
+{
+public:
+    // Shared state cache instance pointer
+    using Pointer = std::shared_ptr<StateCache>;
+
+private:
+    struct Entry
+    {
+        uint64_t version;
+        std::string compact;
+        std::string pretty;
+    };
+
+private:
+    Controller::Pointer m_controller;
+    std::mutex m_mutex;
+    std::atomic<std::shared_ptr<const Entry>> m_entry;
+    std::shared_ptr<Entry> m_retired;
+
+private:
+    /// @brief Serialize current relays state if cached entry is outdated
+    /// @param version Current state version
+    /// @return Up to date entry
+    std::shared_ptr<const Entry> rebuild(uint64_t version);
+
+public:
+    /// @brief Serialize relays state as JSON
+    /// @param body String to append serialized state to
+    /// @param controller Relay controller that names the relays
+    /// @param mask Relays state mask
+    /// @param relays Mask of relays to serialize
+    /// @param pretty Whether or not to indent serialized state
+    static void Serialize(std::string& body, const Controller& controller, const Controller::Mask& mask, const Controller::Mask& relays, bool pretty = false);
+
+public:
+    /// @brief Initialize state cache
+    /// @param controller Relay controller
+    StateCache(Controller::Pointer controller);
+
+    /// @brief Get serialized state of all relays
+    /// @param body String to append serialized state to
+    /// @param pretty Whether or not to get indented body
+    void relays(std::string& body, bool pretty);
+};
+
+} // namespace kc
@@ -2,6 +2,9 @@
 
 // STL modules
 #include <optional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 // Library spdlog
 #include <spdlog/spdlog.h>
@@ -16,6 +19,15 @@ namespace Utility
     /// @param forceColor Whether to force sinks colors or not
     /// @return Created logger
     spdlog::logger CreateLogger(const std::string& name, std::optional<bool> forceColor = {});
+
+    /// @brief Create a logger shared by a long-lived component, its level follows SetLogLevel() for as long as it exists
+    /// @param name Logger name
+    /// @return Created logger
+    std::shared_ptr<spdlog::logger> CreateSharedLogger(const std::string& name);
+
+    /// @brief Set level of loggers created from now on and of existing shared loggers
+    /// @param level Log level to set
+    void SetLogLevel(spdlog::level::level_enum level);
 }
 
 } // namespace kc
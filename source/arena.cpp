@@ -0,0 +1,40 @@
+#include "arena.hpp"
+
+namespace kc {
+
+Arena::Arena(size_t capacity)
+    : m_buffer(std::make_unique<std::byte[]>(capacity))
+    , m_capacity(capacity)
+    , m_used(0)
+{}
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+    size_t start = (m_used + alignment - 1) & ~(alignment - 1);
+    if (alignment <= alignof(std::max_align_t) && start + size <= m_capacity)
+    {
+        m_used = start + size;
+        return m_buffer.get() + start;
+    }
+    return ::operator new(size, std::align_val_t(alignment));
+}
+
+void Arena::deallocate(void* pointer, size_t size, size_t alignment)
+{
+    std::byte* memory = static_cast<std::byte*>(pointer);
+    if (memory >= m_buffer.get() && memory < m_buffer.get() + m_capacity)
+    {
+        // The most recent allocation is given back, so that a growing string reuses its own space
+        if (memory + size == m_buffer.get() + m_used)
+            m_used = memory - m_buffer.get();
+        return;
+    }
+    ::operator delete(pointer, size, std::align_val_t(alignment));
+}
+
+void Arena::reset()
+{
+    m_used = 0;
+}
+
+} // namespace kc
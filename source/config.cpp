@@ -10,12 +10,58 @@ void Config::GenerateSampleFile()
         throw std::runtime_error("kc::Config::GenerateSampleFile(): Couldn't create sample configuration file");
 
     json configJson;
+    configJson[Objects::LogLevel] = Defaults::LogLevel;
+    configJson[Objects::LogAsync] = Defaults::LogAsync;
+    configJson[Objects::LogQueueSize] = Defaults::LogQueueSize;
+    configJson[Objects::LogOverflow] = Defaults::LogOverflow;
     configJson[Objects::HttpPort] = Defaults::HttpPort;
+    configJson[Objects::HttpThreads] = Defaults::HttpThreads;
+    configJson[Objects::HttpTimeout] = Defaults::HttpTimeout;
+    configJson[Objects::HttpIdleTimeout] = Defaults::HttpIdleTimeout;
+    configJson[Objects::HttpHeaderTimeout] = Defaults::HttpHeaderTimeout;
+    configJson[Objects::HttpBodyTimeout] = Defaults::HttpBodyTimeout;
+    configJson[Objects::HttpMaxBody] = Defaults::HttpMaxBody;
+    configJson[Objects::HttpMaxConnections] = Defaults::HttpMaxConnections;
+    configJson[Objects::HttpMaxRequests] = Defaults::HttpMaxRequests;
+    configJson[Objects::HttpConnectionPool] = Defaults::HttpConnectionPool;
+    configJson[Objects::HttpPipeline] = Defaults::HttpPipeline;
+    configJson[Objects::HttpEventQueue] = Defaults::HttpEventQueue;
+    configJson[Objects::ControlPort] = Defaults::ControlPort;
+    configJson[Objects::ScheduleMaxJobs] = Defaults::ScheduleMaxJobs;
+    configJson[Objects::JournalFile] = Defaults::JournalFile;
+    configJson[Objects::JournalSize] = Defaults::JournalSize;
+    configJson[Objects::I2CBackend] = Defaults::I2CBackend;
     configJson[Objects::I2CPort] = Defaults::I2CPort;
+    configJson[Objects::I2CFlushWindow] = Defaults::I2CFlushWindow;
+    configJson[Objects::I2CVerifyInterval] = Defaults::I2CVerifyInterval;
+    configJson[Objects::I2CSimulatedLatency] = Defaults::I2CSimulatedLatency;
+    configJson[Objects::I2CSimulatedFailureRate] = Defaults::I2CSimulatedFailureRate;
+    configJson[Objects::I2CSimulatedDriftRate] = Defaults::I2CSimulatedDriftRate;
+    for (uint8_t address : Defaults::BoardAddresses)
+    {
+        json boardJson;
+        boardJson[Objects::BoardBus] = Defaults::I2CPort;
+        boardJson[Objects::BoardAddress] = address;
+        boardJson[Objects::BoardChannels] = Defaults::BoardChannels;
+        boardJson[Objects::BoardActiveLow] = Defaults::BoardActiveLow;
+        configJson[Objects::Boards].push_back(boardJson);
+    }
     configFile << configJson.dump(4) << '\n';
 }
 
-Config::Config()
+std::string Config::DefaultRelayName(size_t relay)
+{
+    // The first relays keep the names they had when exactly two 8-channel boards were supported
+    constexpr const char* Names[] = {
+        "one", "two", "three", "four", "five", "six", "seven", "eight",
+        "nine", "ten", "eleven", "twelve", "thirteen", "fourteen", "fifteen", "sixteen",
+    };
+    if (relay < std::size(Names))
+        return Names[relay];
+    return fmt::format("relay{}", relay + 1);
+}
+
+json Config::ReadFile()
 {
     std::ifstream configFile(ConfigFile);
     if (!configFile)
@@ -23,14 +69,223 @@ Config::Config()
 
     try
     {
-        json configJson = json::parse(configFile);
-        m_httpPort = configJson[Objects::HttpPort];
-        m_i2cPort = configJson[Objects::I2CPort];
+        return json::parse(configFile);
+    }
+    catch (const json::exception&)
+    {
+        throw Error(fmt::format("Couldn't parse configuration file \"{}\" JSON", ConfigFile).c_str());
+    }
+}
+
+bool Config::ValidRelayName(const std::string& name)
+{
+    if (name.empty())
+        return false;
+
+    for (char character : name)
+    {
+        if (!(character >= 'a' && character <= 'z') && !(character >= '0' && character <= '9') && character != '-' && character != '_')
+            return false;
+    }
+    return true;
+}
+
+void Config::parseBoards(const json& configJson)
+{
+    if (!configJson.contains(Objects::Boards))
+    {
+        for (uint8_t address : Defaults::BoardAddresses)
+            m_boards.push_back({ m_i2cPort, address, Defaults::BoardChannels, Defaults::BoardActiveLow, {} });
+    }
+    else
+    {
+        for (const json& boardJson : configJson.at(Objects::Boards))
+        {
+            Board board;
+            board.bus = boardJson.value(Objects::BoardBus, m_i2cPort);
+            int address = boardJson.at(Objects::BoardAddress);
+            if (address < 0x03 || address > 0x77)
+                throw Error(fmt::format("\"{}\" of every board must be between 3 and 119", Objects::BoardAddress).c_str());
+            board.address = static_cast<uint8_t>(address);
+            board.channels = boardJson.value(Objects::BoardChannels, Defaults::BoardChannels);
+            if (board.channels < 1 || board.channels > 16)
+                throw Error(fmt::format("\"{}\" of every board must be between 1 and 16", Objects::BoardChannels).c_str());
+            board.activeLow = boardJson.value(Objects::BoardActiveLow, Defaults::BoardActiveLow);
+            board.names = boardJson.value(Objects::BoardNames, std::vector<std::string>());
+            if (!board.names.empty() && board.names.size() != static_cast<size_t>(board.channels))
+                throw Error(fmt::format("\"{}\" of a board must name every one of its channels", Objects::BoardNames).c_str());
+            m_boards.push_back(std::move(board));
+        }
+    }
+
+    if (m_boards.empty())
+        throw Error(fmt::format("\"{}\" must contain at least one board", Objects::Boards).c_str());
+
+    size_t relays = 0;
+    std::unordered_set<std::string> devices, names;
+    for (Board& board : m_boards)
+    {
+        if (!devices.insert(fmt::format("{}:{}", board.bus, board.address)).second)
+            throw Error(fmt::format("\"{}\" must not contain two boards with the same bus and address", Objects::Boards).c_str());
+
+        for (int channel = 0; channel < board.channels; ++channel)
+        {
+            if (board.names.size() < static_cast<size_t>(board.channels))
+                board.names.push_back(DefaultRelayName(relays));
+
+            // "events" is taken by the relay state event stream resource
+            const std::string& name = board.names[channel];
+            if (!ValidRelayName(name) || name == "events")
+                throw Error(fmt::format("Relay name \"{}\" must consist of lowercase letters, digits, '-' and '_' and must not be \"events\"", name).c_str());
+            if (!names.insert(name).second)
+                throw Error(fmt::format("Relay name \"{}\" is not unique", name).c_str());
+            ++relays;
+        }
+    }
+
+    if (relays > RelaySet::MaxRelays)
+        throw Error(fmt::format("\"{}\" must contain at most {} relays in total", Objects::Boards, RelaySet::MaxRelays).c_str());
+}
+
+Config::Config()
+    : Config(ReadFile())
+{}
+
+Config::Config(const json& configJson)
+{
+    Settings settings;
+    try
+    {
+        std::string logLevel = configJson.value(Objects::LogLevel, Defaults::LogLevel);
+        settings.logLevel = spdlog::level::from_str(logLevel);
+        if (settings.logLevel == spdlog::level::off && logLevel != "off")
+            throw Error(fmt::format("\"{}\" must be one of \"trace\", \"debug\", \"info\", \"warning\", \"error\", \"critical\" or \"off\"", Objects::LogLevel).c_str());
+
+        m_logAsync = configJson.value(Objects::LogAsync, Defaults::LogAsync);
+        m_logQueueSize = configJson.value(Objects::LogQueueSize, Defaults::LogQueueSize);
+        std::string logOverflow = configJson.value(Objects::LogOverflow, Defaults::LogOverflow);
+        if (logOverflow == "drop")
+            m_logOverflow = LogOverflow::Drop;
+        else if (logOverflow == "block")
+            m_logOverflow = LogOverflow::Block;
+        else
+            throw Error(fmt::format("\"{}\" must be one of \"drop\" or \"block\"", Objects::LogOverflow).c_str());
+
+        m_httpPort = configJson.at(Objects::HttpPort);
+        m_httpThreads = configJson.value(Objects::HttpThreads, Defaults::HttpThreads);
+        settings.httpTimeout = std::chrono::seconds(configJson.value(Objects::HttpTimeout, Defaults::HttpTimeout));
+        settings.httpIdleTimeout = std::chrono::seconds(configJson.value(Objects::HttpIdleTimeout, Defaults::HttpIdleTimeout));
+        settings.httpHeaderTimeout = std::chrono::seconds(configJson.value(Objects::HttpHeaderTimeout, Defaults::HttpHeaderTimeout));
+        settings.httpBodyTimeout = std::chrono::seconds(configJson.value(Objects::HttpBodyTimeout, Defaults::HttpBodyTimeout));
+        settings.httpMaxBody = configJson.value(Objects::HttpMaxBody, Defaults::HttpMaxBody);
+        settings.httpMaxConnections = configJson.value(Objects::HttpMaxConnections, Defaults::HttpMaxConnections);
+        settings.httpMaxRequests = configJson.value(Objects::HttpMaxRequests, Defaults::HttpMaxRequests);
+        m_httpConnectionPool = configJson.value(Objects::HttpConnectionPool, Defaults::HttpConnectionPool);
+        std::string httpPipeline = configJson.value(Objects::HttpPipeline, Defaults::HttpPipeline);
+        if (httpPipeline == "callback")
+            settings.httpPipeline = HttpPipeline::Callback;
+        else if (httpPipeline == "coroutine")
+            settings.httpPipeline = HttpPipeline::Coroutine;
+        else
+            throw Error(fmt::format("\"{}\" must be one of \"callback\" or \"coroutine\"", Objects::HttpPipeline).c_str());
+        settings.httpEventQueue = configJson.value(Objects::HttpEventQueue, Defaults::HttpEventQueue);
+        m_controlPort = configJson.value(Objects::ControlPort, Defaults::ControlPort);
+        settings.scheduleMaxJobs = configJson.value(Objects::ScheduleMaxJobs, Defaults::ScheduleMaxJobs);
+        m_journalFile = configJson.value(Objects::JournalFile, Defaults::JournalFile);
+        m_journalSize = configJson.value(Objects::JournalSize, Defaults::JournalSize);
+        m_i2cBackend = I2C::ParseBackend(configJson.value(Objects::I2CBackend, Defaults::I2CBackend));
+        m_i2cPort = configJson.at(Objects::I2CPort);
+        m_i2cFlushWindow = std::chrono::microseconds(configJson.value(Objects::I2CFlushWindow, Defaults::I2CFlushWindow));
+        m_i2cVerifyInterval = std::chrono::milliseconds(configJson.value(Objects::I2CVerifyInterval, Defaults::I2CVerifyInterval));
+        m_i2cSimulation.latency = std::chrono::microseconds(configJson.value(Objects::I2CSimulatedLatency, Defaults::I2CSimulatedLatency));
+        m_i2cSimulation.failureRate = configJson.value(Objects::I2CSimulatedFailureRate, Defaults::I2CSimulatedFailureRate);
+        m_i2cSimulation.driftRate = configJson.value(Objects::I2CSimulatedDriftRate, Defaults::I2CSimulatedDriftRate);
+        parseBoards(configJson);
     }
     catch (const json::exception&)
     {
         throw Error(fmt::format("Couldn't parse configuration file \"{}\" JSON", ConfigFile).c_str());
     }
+    catch (const std::invalid_argument&)
+    {
+        throw Error(fmt::format("\"{}\" must be one of \"wiringpi\", \"linux\" or \"simulated\"", Objects::I2CBackend).c_str());
+    }
+
+    if (m_logQueueSize < 2 || m_logQueueSize > 1'048'576)
+        throw Error(fmt::format("\"{}\" must be between 2 and 1048576", Objects::LogQueueSize).c_str());
+    if (m_httpThreads < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpThreads).c_str());
+    if (settings.httpTimeout.count() < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpTimeout).c_str());
+    if (settings.httpIdleTimeout.count() < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpIdleTimeout).c_str());
+    if (settings.httpHeaderTimeout.count() < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpHeaderTimeout).c_str());
+    if (settings.httpBodyTimeout.count() < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpBodyTimeout).c_str());
+    if (settings.httpMaxBody < 1 || settings.httpMaxBody > 16'777'216)
+        throw Error(fmt::format("\"{}\" must be between 1 and 16777216 bytes", Objects::HttpMaxBody).c_str());
+    if (settings.httpMaxConnections < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpMaxConnections).c_str());
+    if (settings.httpMaxRequests < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpMaxRequests).c_str());
+    if (m_httpConnectionPool < 0 || m_httpConnectionPool > 65'536)
+        throw Error(fmt::format("\"{}\" must be between 0 and 65536", Objects::HttpConnectionPool).c_str());
+    if (settings.httpEventQueue < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::HttpEventQueue).c_str());
+    if (m_controlPort != 0 && m_controlPort == m_httpPort)
+        throw Error(fmt::format("\"{}\" must differ from \"{}\"", Objects::ControlPort, Objects::HttpPort).c_str());
+    if (settings.scheduleMaxJobs < 1)
+        throw Error(fmt::format("\"{}\" must be at least 1", Objects::ScheduleMaxJobs).c_str());
+    if (m_journalSize < 4096 || m_journalSize > 1'073'741'824)
+        throw Error(fmt::format("\"{}\" must be between 4096 and 1073741824 bytes", Objects::JournalSize).c_str());
+    if (m_i2cFlushWindow.count() < 0 || m_i2cFlushWindow > std::chrono::seconds(1))
+        throw Error(fmt::format("\"{}\" must be between 0 and 1000000 microseconds", Objects::I2CFlushWindow).c_str());
+    if (m_i2cVerifyInterval.count() < 0 || m_i2cVerifyInterval > std::chrono::hours(1))
+        throw Error(fmt::format("\"{}\" must be between 0 and 3600000 milliseconds", Objects::I2CVerifyInterval).c_str());
+    if (m_i2cSimulation.latency.count() < 0)
+        throw Error(fmt::format("\"{}\" must not be negative", Objects::I2CSimulatedLatency).c_str());
+    if (m_i2cSimulation.failureRate < 0.0 || m_i2cSimulation.failureRate > 1.0)
+        throw Error(fmt::format("\"{}\" must be between 0 and 1", Objects::I2CSimulatedFailureRate).c_str());
+    if (m_i2cSimulation.driftRate < 0.0 || m_i2cSimulation.driftRate > 1.0)
+        throw Error(fmt::format("\"{}\" must be between 0 and 1", Objects::I2CSimulatedDriftRate).c_str());
+
+    m_versions.push_back(std::make_unique<const Settings>(settings));
+    m_settings.store(m_versions.back().get(), std::memory_order_release);
+}
+
+bool Config::reload(const Config& next, std::vector<std::string>& restartRequired)
+{
+    auto differs = [&restartRequired](bool differs, const char* object)
+    {
+        if (differs)
+            restartRequired.push_back(object);
+    };
+    differs(m_logAsync != next.m_logAsync, Objects::LogAsync);
+    differs(m_logQueueSize != next.m_logQueueSize, Objects::LogQueueSize);
+    differs(m_logOverflow != next.m_logOverflow, Objects::LogOverflow);
+    differs(m_httpPort != next.m_httpPort, Objects::HttpPort);
+    differs(m_httpThreads != next.m_httpThreads, Objects::HttpThreads);
+    differs(m_httpConnectionPool != next.m_httpConnectionPool, Objects::HttpConnectionPool);
+    differs(m_controlPort != next.m_controlPort, Objects::ControlPort);
+    differs(m_journalFile != next.m_journalFile, Objects::JournalFile);
+    differs(m_journalSize != next.m_journalSize, Objects::JournalSize);
+    differs(m_i2cBackend != next.m_i2cBackend, Objects::I2CBackend);
+    differs(m_i2cPort != next.m_i2cPort, Objects::I2CPort);
+    differs(m_i2cFlushWindow != next.m_i2cFlushWindow, Objects::I2CFlushWindow);
+    differs(m_i2cVerifyInterval != next.m_i2cVerifyInterval, Objects::I2CVerifyInterval);
+    differs(m_i2cSimulation.latency != next.m_i2cSimulation.latency, Objects::I2CSimulatedLatency);
+    differs(m_i2cSimulation.failureRate != next.m_i2cSimulation.failureRate, Objects::I2CSimulatedFailureRate);
+    differs(m_i2cSimulation.driftRate != next.m_i2cSimulation.driftRate, Objects::I2CSimulatedDriftRate);
+    differs(m_boards != next.m_boards, Objects::Boards);
+
+    std::lock_guard lock(m_reloadMutex);
+    if (next.settings() == settings())
+        return false;
+
+    m_versions.push_back(std::make_unique<const Settings>(next.settings()));
+    m_settings.store(m_versions.back().get(), std::memory_order_release);
+    return true;
 }
 
 } // namespace kc
@@ -0,0 +1,109 @@
+#include "config_watcher.hpp"
+
+namespace kc {
+
+void ConfigWatcher::run()
+{
+    pollfd descriptors[] = { { m_inotify, POLLIN, 0 }, { m_stop, POLLIN, 0 } };
+    while (true)
+    {
+        if (poll(descriptors, std::size(descriptors), -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            m_logger->error("Couldn't wait for configuration file changes: errno is {}", errno);
+            return;
+        }
+        if (descriptors[1].revents)
+            return;
+        if (!readEvents())
+            continue;
+
+        // Changes that keep coming are waited out
+        while (poll(descriptors, 1, SettleTime) > 0)
+            readEvents();
+        reload();
+    }
+}
+
+bool ConfigWatcher::readEvents()
+{
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+    if (length <= 0)
+        return false;
+
+    bool changed = false;
+    for (ssize_t offset = 0; offset < length; )
+    {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+        if (event->len != 0 && std::string_view(event->name) == ConfigConst::ConfigFile)
+            changed = true;
+        offset += sizeof(inotify_event) + event->len;
+    }
+    return changed;
+}
+
+void ConfigWatcher::reload()
+{
+    std::vector<std::string> restartRequired;
+    try
+    {
+        Config next;
+        if (m_config->reload(next, restartRequired))
+        {
+            Utility::SetLogLevel(m_config->logLevel());
+            m_logger->info("Configuration file \"{}\" was reloaded", ConfigConst::ConfigFile);
+        }
+    }
+    catch (const Config::Error& error)
+    {
+        m_logger->error("Configuration file \"{}\" change was rejected: {}", ConfigConst::ConfigFile, error.what());
+        return;
+    }
+
+    for (const std::string& object : restartRequired)
+        m_logger->warn("Change of \"{}\" takes effect after restart", object);
+}
+
+ConfigWatcher::ConfigWatcher(Config::Pointer config)
+    : m_logger(Utility::CreateSharedLogger("config_watcher"))
+    , m_config(config)
+    , m_inotify(-1)
+    , m_stop(-1)
+{
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify == -1)
+        throw std::runtime_error(fmt::format("kc::ConfigWatcher::ConfigWatcher(): Couldn't initialize inotify: errno is {}", errno));
+
+    // Only completed writes and renames are watched, a file that is still being written isn't read
+    if (inotify_add_watch(m_inotify, ".", IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+    {
+        int error = errno;
+        close(m_inotify);
+        throw std::runtime_error(fmt::format("kc::ConfigWatcher::ConfigWatcher(): Couldn't watch configuration file directory: errno is {}", error));
+    }
+
+    m_stop = eventfd(0, EFD_CLOEXEC);
+    if (m_stop == -1)
+    {
+        int error = errno;
+        close(m_inotify);
+        throw std::runtime_error(fmt::format("kc::ConfigWatcher::ConfigWatcher(): Couldn't create stop event: errno is {}", error));
+    }
+
+    m_thread = std::thread(&ConfigWatcher::run, this);
+    m_logger->info("Watching configuration file \"{}\" for changes", ConfigConst::ConfigFile);
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    uint64_t value = 1;
+    if (write(m_stop, &value, sizeof(value)) == -1)
+        m_logger->error("Couldn't stop configuration file watcher: errno is {}", errno);
+    m_thread.join();
+    close(m_stop);
+    close(m_inotify);
+}
+
+} // namespace kc
@@ -0,0 +1,381 @@
+#include "control_server.hpp"
+
+namespace kc {
+
+/// @brief Write big-endian integer
+/// @param frame Frame to write to
+/// @param value Value to write
+/// @param size Count of bytes to write
+static void WriteInteger(uint8_t* frame, uint64_t value, size_t size)
+{
+    for (size_t index = 0; index < size; ++index)
+        frame[index] = static_cast<uint8_t>(value >> (8 * (size - index - 1)));
+}
+
+/// @brief Read big-endian integer
+/// @param frame Frame to read from
+/// @param size Count of bytes to read
+/// @return Read value
+static uint64_t ReadInteger(const uint8_t* frame, size_t size)
+{
+    uint64_t value = 0;
+    for (size_t index = 0; index < size; ++index)
+        value = (value << 8) | frame[index];
+    return value;
+}
+
+void ControlServer::EncodeRequest(const Request& request, uint8_t* frame)
+{
+    frame[0] = request.version;
+    frame[1] = static_cast<uint8_t>(request.opcode);
+    frame[2] = request.flags;
+    frame[3] = request.bank;
+    WriteInteger(frame + 4, request.sequence, 4);
+    WriteInteger(frame + 8, request.mask, 2);
+    WriteInteger(frame + 10, request.value, 2);
+}
+
+ControlServer::Request ControlServer::DecodeRequest(const uint8_t* frame)
+{
+    Request request;
+    request.version = frame[0];
+    request.opcode = static_cast<Opcode>(frame[1]);
+    request.flags = frame[2];
+    request.bank = frame[3];
+    request.sequence = static_cast<uint32_t>(ReadInteger(frame + 4, 4));
+    request.mask = static_cast<uint16_t>(ReadInteger(frame + 8, 2));
+    request.value = static_cast<uint16_t>(ReadInteger(frame + 10, 2));
+    return request;
+}
+
+void ControlServer::EncodeResponse(const Response& response, uint8_t* frame)
+{
+    frame[0] = response.version;
+    frame[1] = static_cast<uint8_t>(response.opcode);
+    frame[2] = static_cast<uint8_t>(response.status);
+    frame[3] = response.bank;
+    WriteInteger(frame + 4, response.sequence, 4);
+    WriteInteger(frame + 8, response.stateVersion, 6);
+    WriteInteger(frame + 14, response.mask, 2);
+}
+
+ControlServer::Response ControlServer::DecodeResponse(const uint8_t* frame)
+{
+    Response response;
+    response.version = frame[0];
+    response.opcode = static_cast<Opcode>(frame[1]);
+    response.status = static_cast<Status>(frame[2]);
+    response.bank = frame[3];
+    response.sequence = static_cast<uint32_t>(ReadInteger(frame + 4, 4));
+    response.stateVersion = ReadInteger(frame + 8, 6);
+    response.mask = static_cast<uint16_t>(ReadInteger(frame + 14, 2));
+    return response;
+}
+
+void ControlServer::Connection::receive()
+{
+    auto self = shared_from_this();
+    m_socket.async_read_some(asio::buffer(m_requests.data() + m_received, m_requests.size() - m_received), BindHandler(m_handlerMemory, [self](boost::system::error_code error, std::size_t bytesTransferred)
+    {
+        if (error)
+            return;
+
+        self->m_received += bytesTransferred;
+        self->respond(self->m_received / RequestSize);
+    }));
+}
+
+void ControlServer::Connection::respond(size_t frames)
+{
+    if (frames == 0)
+    {
+        receive();
+        return;
+    }
+
+    /*
+    *   All frames that arrived together are answered with a single write.
+    *   After a frame with unsupported version the stream can't be trusted to be aligned to frames,
+    *   so the rest of it is discarded and the connection is closed.
+    */
+    bool supported = true;
+    bool waiting = false;
+    size_t answered = 0;
+    while (answered < frames && supported)
+    {
+        supported = m_server->apply(m_requests.data() + answered * RequestSize, m_responses.data() + answered * ResponseSize, &m_waiting[answered]);
+        waiting = waiting || m_waiting[answered];
+        ++answered;
+    }
+    m_server->m_counters.add(TcpRequests, answered);
+
+    // A partially received frame is moved to the front of the buffer to be completed by the next read
+    size_t consumed = frames * RequestSize;
+    std::memmove(m_requests.data(), m_requests.data() + consumed, m_received - consumed);
+    m_received -= consumed;
+
+    if (!waiting)
+    {
+        send(answered, supported);
+        return;
+    }
+
+    // A single wait covers the whole batch, the worker thread is free to handle other requests meanwhile
+    auto self = shared_from_this();
+    m_server->m_controller->flush([self, answered, supported](bool success)
+    {
+        asio::post(self->m_socket.get_executor(), BindHandler(self->m_handlerMemory, [self, answered, supported, success]()
+        {
+            for (size_t index = 0; !success && index < answered; ++index)
+            {
+                if (!self->m_waiting[index])
+                    continue;
+
+                uint8_t* frame = self->m_responses.data() + index * ResponseSize;
+                Response response = DecodeResponse(frame);
+                response.status = Status::WriteFailed;
+                EncodeResponse(response, frame);
+                self->m_server->m_counters.add(Errors);
+            }
+            self->send(answered, supported);
+        }));
+    });
+}
+
+void ControlServer::Connection::send(size_t answered, bool supported)
+{
+    auto self = shared_from_this();
+    asio::async_write(m_socket, asio::buffer(m_responses.data(), answered * ResponseSize), BindHandler(m_handlerMemory, [self, supported](boost::system::error_code error, std::size_t bytesTransferred)
+    {
+        boost::ignore_unused(bytesTransferred);
+        if (error)
+            return;
+
+        if (!supported)
+        {
+            self->m_socket.shutdown(Socket::shutdown_send, error);
+            return;
+        }
+        self->receive();
+    }));
+}
+
+ControlServer::Connection::Connection(ControlServer::Pointer server, Socket&& socket)
+    : m_server(server)
+    , m_socket(std::move(socket))
+    , m_received(0)
+{
+    m_server->m_counters.add(Opened);
+}
+
+ControlServer::Connection::~Connection()
+{
+    m_server->m_counters.add(Closed);
+}
+
+void ControlServer::Connection::start()
+{
+    /*
+    *   Frames are tiny and latency matters more than throughput, so they are never delayed by Nagle's algorithm.
+    *   Keep-alive probes reveal peers that vanished without closing their long-lived connections.
+    */
+    boost::system::error_code error;
+    m_socket.set_option(asio::ip::tcp::no_delay(true), error);
+    m_socket.set_option(asio::socket_base::keep_alive(true), error);
+    receive();
+}
+
+bool ControlServer::apply(const uint8_t* frame, uint8_t* response, bool* waiting)
+{
+    if (waiting)
+        *waiting = false;
+
+    Request request = DecodeRequest(frame);
+    Response result = { Version, request.opcode, Status::Ok, request.bank, request.sequence, 0, 0 };
+    Controller::Snapshot snapshot;
+    auto respond = [&result, &snapshot, &request, response]()
+    {
+        result.stateVersion = snapshot.version;
+        result.mask = static_cast<uint16_t>(snapshot.mask.bits(request.bank * BankRelays, BankRelays));
+        EncodeResponse(result, response);
+    };
+
+    if (request.version != Version)
+    {
+        result.status = Status::BadVersion;
+        snapshot = m_controller->snapshot();
+        respond();
+        m_counters.add(Errors);
+        return false;
+    }
+
+    Controller::Mask mask = Controller::Mask::FromBits(request.mask, request.bank * BankRelays);
+    Controller::Mask value = Controller::Mask::FromBits(request.value, request.bank * BankRelays);
+    if (!waiting && (request.flags & WaitFlag))
+    {
+        // Waiting for drivers would stall every datagram queued behind this one
+        result.status = Status::BadFlags;
+        snapshot = m_controller->snapshot();
+    }
+    else if (request.bank * BankRelays >= m_controller->relays() || (mask & ~m_controller->allRelays()).any())
+    {
+        result.status = Status::BadArgument;
+        snapshot = m_controller->snapshot();
+    }
+    else
+    {
+        switch (request.opcode)
+        {
+            case Opcode::GetMask:
+                snapshot = m_controller->snapshot();
+                break;
+            case Opcode::SetMask:
+                snapshot = m_controller->update(mask, value);
+                break;
+            case Opcode::SetBits:
+                snapshot = m_controller->update(mask, mask);
+                break;
+            case Opcode::ClearBits:
+                snapshot = m_controller->update(mask, {});
+                break;
+            case Opcode::Pulse:
+                if (request.value == 0)
+                {
+                    result.status = Status::BadArgument;
+                    snapshot = m_controller->snapshot();
+                    break;
+                }
+                snapshot = m_controller->pulse(mask, std::chrono::milliseconds(request.value));
+                break;
+            default:
+                result.status = Status::BadOpcode;
+                snapshot = m_controller->snapshot();
+                break;
+        }
+    }
+
+    if (waiting)
+        *waiting = result.status == Status::Ok && request.opcode != Opcode::GetMask && (request.flags & WaitFlag);
+
+    if (result.status != Status::Ok)
+        m_counters.add(Errors);
+    respond();
+    return true;
+}
+
+void ControlServer::startAccepting()
+{
+    auto self = shared_from_this();
+    m_acceptor.async_accept(asio::make_strand(m_context), [self](boost::system::error_code error, Socket socket)
+    {
+        if (error)
+        {
+            if (error == asio::error::operation_aborted)
+                return;
+
+            // The server never stops accepting for good, running out of file descriptors only pauses it
+            self->m_counters.add(AcceptErrors);
+            self->m_logger->error("Couldn't accept connection: \"{}\" ({})", error.message(), error.value());
+            self->m_acceptRetry.expires_after(AcceptRetryDelay);
+            self->m_acceptRetry.async_wait([self](boost::system::error_code error)
+            {
+                if (!error)
+                    self->startAccepting();
+            });
+            return;
+        }
+
+        std::make_shared<Connection>(self, std::move(socket))->start();
+        self->startAccepting();
+    });
+}
+
+void ControlServer::startReceiving()
+{
+    auto self = shared_from_this();
+    m_udpSocket.async_receive_from(asio::buffer(m_udpRequest), m_udpPeer, BindHandler(m_udpHandlerMemory, [self](boost::system::error_code error, std::size_t bytesTransferred)
+    {
+        if (error == asio::error::operation_aborted)
+            return;
+
+        if (!error)
+            self->handleDatagram(bytesTransferred);
+        self->startReceiving();
+    }));
+}
+
+void ControlServer::handleDatagram(size_t size)
+{
+    /*
+    *   The socket is non-blocking: datagrams that arrived while one was handled are received right away
+    *   without going back through the reactor, and a response that doesn't fit into the send buffer
+    *   is dropped rather than stalling the worker, the client retransmits it.
+    */
+    for (size_t handled = 0; handled < BatchFrames; ++handled)
+    {
+        // Receive buffer is one byte longer than a frame, so that oversized datagrams are recognized
+        if (size == RequestSize)
+        {
+            apply(m_udpRequest.data(), m_udpResponse.data(), nullptr);
+            m_counters.add(UdpRequests);
+
+            boost::system::error_code error;
+            m_udpSocket.send_to(asio::buffer(m_udpResponse), m_udpPeer, 0, error);
+            if (error)
+                m_counters.add(Dropped);
+        }
+        else
+            m_counters.add(Errors);
+
+        // A datagram received past the batch limit would be overwritten by the next asynchronous receive
+        if (handled + 1 == BatchFrames)
+            return;
+
+        boost::system::error_code error;
+        size = m_udpSocket.receive_from(asio::buffer(m_udpRequest), m_udpPeer, 0, error);
+        if (error)
+            return;
+    }
+}
+
+ControlServer::ControlServer(Config::Pointer config, Controller::Pointer controller, asio::io_context& context, Listeners& listeners)
+    : m_logger(Utility::CreateSharedLogger("control_server"))
+    , m_config(config)
+    , m_controller(controller)
+    , m_context(context)
+    , m_acceptor(listeners.acceptor(context, config->controlPort()))
+    , m_acceptRetry(context)
+    , m_udpSocket(listeners.datagramSocket(context, config->controlPort()))
+    , m_counters(CountersCount)
+{
+    m_udpSocket.non_blocking(true);
+}
+
+void ControlServer::start()
+{
+    m_logger->info("Listening for control requests on TCP and UDP port {}", m_config->controlPort());
+    startAccepting();
+    startReceiving();
+}
+
+void ControlServer::writeMetrics(std::string& metrics) const
+{
+    Metrics::WriteHeader(metrics, "loraine_control_requests_total", "Binary control protocol requests handled", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_control_requests_total{{transport=\"tcp\"}} {}\n", m_counters.value(TcpRequests));
+    fmt::format_to(std::back_inserter(metrics), "loraine_control_requests_total{{transport=\"udp\"}} {}\n", m_counters.value(UdpRequests));
+
+    Metrics::WriteHeader(metrics, "loraine_control_errors_total", "Binary control protocol requests that were malformed or failed", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_control_errors_total {}\n", m_counters.value(Errors));
+
+    Metrics::WriteHeader(metrics, "loraine_control_responses_dropped_total", "Binary control protocol UDP responses that couldn't be sent", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_control_responses_dropped_total {}\n", m_counters.value(Dropped));
+
+    Metrics::WriteHeader(metrics, "loraine_control_accept_errors_total", "Binary control protocol TCP connections that couldn't be accepted", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_control_accept_errors_total {}\n", m_counters.value(AcceptErrors));
+
+    Metrics::WriteHeader(metrics, "loraine_control_connections", "Open binary control protocol TCP connections", "gauge");
+    fmt::format_to(std::back_inserter(metrics), "loraine_control_connections {}\n",
+        static_cast<int64_t>(m_counters.value(Opened) - m_counters.value(Closed)));
+}
+
+} // namespace kc
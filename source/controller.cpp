@@ -2,227 +2,377 @@
 
 namespace kc {
 
-uint16_t Controller::ControlMask(Relay relay)
+/// @brief Count relays on all configured boards
+/// @param config Initialized config
+/// @return Count of relays
+static size_t CountRelays(const Config& config)
 {
-    switch (relay)
+    size_t relays = 0;
+    for (const Config::Board& board : config.boards())
+        relays += board.channels;
+    return relays;
+}
+
+std::vector<OutputStage::Driver> Controller::OpenDrivers(const Config& config)
+{
+    std::vector<OutputStage::Driver> drivers;
+    for (const Config::Board& board : config.boards())
+    {
+        drivers.push_back({
+            I2C::Open(config.i2cBackend(), board.bus, board.address, config.i2cSimulation()),
+            static_cast<size_t>((board.channels + 7) / 8)
+        });
+    }
+    return drivers;
+}
+
+uint64_t Controller::switchRelays(bool force)
+{
+    /*
+    *   Drivers are always switched to the latest state, not to the state of the caller's update:
+    *   concurrent updates may reach this point in any order, but drivers end up in the latest state.
+    */
+    std::lock_guard lock(m_mutex);
+    Snapshot current = snapshot();
+
+    /*
+    *   Relays of a board are consecutive, so their states are extracted from the set a word at a time.
+    *   Due to sinking current architecture of active-low relay assemblies,
+    *   drivers' LOW (0) signal enables and HIGH (1) signal disables their relays.
+    */
+    for (const Board& board : m_boards)
     {
-        case Relay::One:
-            return 0b0000'0000'0000'0001;
-        case Relay::Two:
-            return 0b0000'0000'0000'0010;
-        case Relay::Three:
-            return 0b0000'0000'0000'0100;
-        case Relay::Four:
-            return 0b0000'0000'0000'1000;
-        case Relay::Five:
-            return 0b0000'0000'0001'0000;
-        case Relay::Six:
-            return 0b0000'0000'0010'0000;
-        case Relay::Seven:
-            return 0b0000'0000'0100'0000;
-        case Relay::Eight:
-            return 0b0000'0000'1000'0000;
-        case Relay::Nine:
-            return 0b0000'0001'0000'0000;
-        case Relay::Ten:
-            return 0b0000'0010'0000'0000;
-        case Relay::Eleven:
-            return 0b0000'0100'0000'0000;
-        case Relay::Twelve:
-            return 0b0000'1000'0000'0000;
-        case Relay::Thirteen:
-            return 0b0001'0000'0000'0000;
-        case Relay::Fourteen:
-            return 0b0010'0000'0000'0000;
-        case Relay::Fifteen:
-            return 0b0100'0000'0000'0000;
-        case Relay::Sixteen:
-            return 0b1000'0000'1000'0000;
+        uint64_t states = current.mask.bits(board.first, board.channels);
+        if (board.activeLow)
+            states = ~states;
+        for (size_t index = 0; index < board.width; ++index)
+            m_driverStates[board.offset + index] = static_cast<uint8_t>(states >> (8 * index));
     }
+    uint64_t sequence = m_output.submit(m_driverStates.data(), force);
+
+    // Listener is notified under the lock, so it observes snapshots in version order
+    if (m_listener)
+        m_listener(current);
+    return sequence;
+}
+
+void Controller::runPulses()
+{
+    std::unique_lock lock(m_updateMutex);
+    while (!m_pulseStop)
+    {
+        auto release = NoRelease;
+        m_pulsing.forEach([this, &release](Relay relay) { release = std::min(release, m_releases[relay]); });
+        if (release == NoRelease)
+            m_pulseCondition.wait(lock);
+        else
+            m_pulseCondition.wait_until(lock, release);
+
+        /*
+        *   Releases are applied under the update lock: a manual change either cancels a release before it is due,
+        *   or is applied after it, so a release never overrides a later manual change.
+        */
+        auto now = std::chrono::steady_clock::now();
+        Mask released;
+        m_pulsing.forEach([this, now, &released](Relay relay)
+        {
+            auto& relayRelease = m_releases[relay];
+            if (relayRelease > now)
+                return;
 
-    throw std::runtime_error(fmt::format(
-        "kc::Controller::ControlMask(): Relay is unknown [relay: {}]",
-        static_cast<int>(relay)
-    ));
+            auto board = std::upper_bound(m_boards.begin(), m_boards.end(), relay, [](Relay relay, const Board& board)
+            {
+                return relay < board.first;
+            });
+            m_releaseLateness.observe(board - m_boards.begin() - 1, now - relayRelease);
+            relayRelease = NoRelease;
+            released.set(relay);
+        });
+        if (released.any())
+        {
+            m_pulsing &= ~released;
+            apply(released, {});
+        }
+    }
 }
 
-const char* Controller::UniqueName(Relay relay)
+Controller::Controller(Config::Pointer config)
+    : m_words(0)
+    , m_sequence(0)
+    , m_output(OpenDrivers(*config), config->i2cFlushWindow(), config->i2cVerifyInterval())
+    , m_toggles(CountRelays(*config))
+    , m_pulses(CountRelays(*config))
+    , m_releaseLateness(config->boards().size())
+    , m_journalVersion(0)
+    , m_pulseStop(false)
 {
-    switch (relay)
+    size_t offset = 0;
+    for (const Config::Board& board : config->boards())
     {
-        case Relay::One:
-            return "one";
-        case Relay::Two:
-            return "two";
-        case Relay::Three:
-            return "three";
-        case Relay::Four:
-            return "four";
-        case Relay::Five:
-            return "five";
-        case Relay::Six:
-            return "six";
-        case Relay::Seven:
-            return "seven";
-        case Relay::Eight:
-            return "eight";
-        case Relay::Nine:
-            return "nine";
-        case Relay::Ten:
-            return "ten";
-        case Relay::Eleven:
-            return "eleven";
-        case Relay::Twelve:
-            return "twelve";
-        case Relay::Thirteen:
-            return "thirteen";
-        case Relay::Fourteen:
-            return "fourteen";
-        case Relay::Fifteen:
-            return "fifteen";
-        case Relay::Sixteen:
-            return "sixteen";
+        size_t width = (board.channels + 7) / 8;
+        m_boards.push_back({ fmt::format("{}:{:#04x}", board.bus, board.address), m_names.size(), board.channels, board.activeLow, offset, width });
+        offset += width;
+
+        for (const std::string& name : board.names)
+        {
+            m_relays.emplace(name, m_names.size());
+            m_names.push_back(name);
+        }
     }
+    m_driverStates.resize(offset);
+    m_allRelays = RelaySet::Range(0, m_names.size());
+    m_words = (m_names.size() + RelaySet::WordBits - 1) / RelaySet::WordBits;
+    for (std::atomic<uint64_t>& word : m_state)
+        word.store(0, std::memory_order_relaxed);
+    m_releases.assign(m_names.size(), NoRelease);
 
-    throw std::runtime_error(fmt::format(
-        "kc::Controller::UniqueName(): Relay is unknown [relay: {}]",
-        static_cast<int>(relay)
-    ));
+    // Serialized state orders relays by name, the order is computed once instead of on every serialization
+    m_ordered.resize(m_names.size());
+    for (Relay relay = 0; relay < m_names.size(); ++relay)
+        m_ordered[relay] = relay;
+    std::sort(m_ordered.begin(), m_ordered.end(), [this](Relay left, Relay right) { return m_names[left] < m_names[right]; });
+    m_ranks.resize(m_names.size());
+    for (size_t rank = 0; rank < m_ordered.size(); ++rank)
+        m_ranks[m_ordered[rank]] = static_cast<uint32_t>(rank);
+
+    /*
+    *   Journaled state is restored before drivers are first written,
+    *   so relays are switched right to it with a single write per driver.
+    */
+    if (!config->journalFile().empty())
+    {
+        m_journal = std::make_unique<Journal>(config->journalFile(), config->journalSize(), m_names.size());
+        if (const std::optional<Journal::State>& restored = m_journal->restored())
+        {
+            for (size_t index = 0; index < m_words; ++index)
+                m_state[index].store(restored->mask.word(index), std::memory_order_relaxed);
+            m_sequence.store(restored->version * 2, std::memory_order_release);
+            m_journaled = restored->mask;
+            m_journalVersion = restored->version;
+        }
+    }
+
+    if (!m_output.wait(switchRelays(true)))
+        throw std::runtime_error("kc::Controller::Controller(): Couldn't switch relays to initial state");
+
+    /*
+    *   Pulses are timed by their own thread, so that load of server threads can't stretch them.
+    *   Real-time priority makes it win over them for the CPU too, but requires privileges: without them it's kept default.
+    */
+    m_pulseThread = std::thread(&Controller::runPulses, this);
+    sched_param parameters = {};
+    parameters.sched_priority = 1;
+    pthread_setschedparam(m_pulseThread.native_handle(), SCHED_FIFO, &parameters);
 }
 
-const char* Controller::Name(Relay relay)
+Controller::~Controller()
 {
-    switch (relay)
     {
-        case Relay::One:
-            return "Relay #1";
-        case Relay::Two:
-            return "Relay #2";
-        case Relay::Three:
-            return "Relay #3";
-        case Relay::Four:
-            return "Relay #4";
-        case Relay::Five:
-            return "Relay #5";
-        case Relay::Six:
-            return "Relay #6";
-        case Relay::Seven:
-            return "Relay #7";
-        case Relay::Eight:
-            return "Relay #8";
-        case Relay::Nine:
-            return "Relay #9";
-        case Relay::Ten:
-            return "Relay #10";
-        case Relay::Eleven:
-            return "Relay #11";
-        case Relay::Twelve:
-            return "Relay #12";
-        case Relay::Thirteen:
-            return "Relay #13";
-        case Relay::Fourteen:
-            return "Relay #14";
-        case Relay::Fifteen:
-            return "Relay #15";
-        case Relay::Sixteen:
-            return "Relay #16";
+        // Pulses are cut short rather than dropped, a pulsing relay must never be left enabled
+        std::lock_guard lock(m_updateMutex);
+        if (m_pulsing.any())
+        {
+            Mask released = m_pulsing;
+            released.forEach([this](Relay relay) { m_releases[relay] = NoRelease; });
+            m_pulsing = {};
+            apply(released, {});
+        }
+        m_pulseStop = true;
     }
+    m_pulseCondition.notify_one();
+    m_pulseThread.join();
 
-    throw std::runtime_error(fmt::format(
-        "kc::Controller::Name(): Relay is unknown [relay: {}]",
-        static_cast<int>(relay)
-    ));
+    // Journaled relays keep their state, so that it's restored on the next start without flapping
+    if (!m_journal)
+        setAllStates(false);
 }
 
-void Controller::switchRelays(bool force)
+std::optional<Controller::Relay> Controller::find(std::string_view uniqueName) const
 {
-    uint16_t switchState = 0;
-    for (Relay relay = Relay::One; relay != Relay::MaxRelays; ++relay)
+    auto relay = m_relays.find(uniqueName);
+    if (relay == m_relays.end())
+        return {};
+    return relay->second;
+}
+
+uint64_t Controller::version() const
+{
+    return m_sequence.load(std::memory_order_acquire) / 2;
+}
+
+Controller::Snapshot Controller::snapshot() const
+{
+    Snapshot snapshot;
+    while (true)
     {
-        /*
-        *   Due to sinking current architecture of relay assemblies,
-        *   drivers' LOW (0) signal enables and HIGH (1) signal disables the relay.
-        */
-        if (!m_relays[relay].enabled)
-            switchState |= ControlMask(relay);
+        uint64_t sequence = m_sequence.load(std::memory_order_acquire);
+        if (sequence % 2 != 0)
+        {
+            // A writer only stores a few words, but it may have been preempted while storing them
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (size_t index = 0; index < m_words; ++index)
+            snapshot.mask.setWord(index, m_state[index].load(std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            snapshot.version = sequence / 2;
+            return snapshot;
+        }
     }
+}
 
-    uint8_t switchState1 = static_cast<uint8_t>(switchState);
-    static uint8_t previousSwitchState1 = switchState1;
-    if (force || switchState1 != previousSwitchState1)
+Controller::State Controller::getState(Relay relay) const
+{
+    if (relay >= relays())
     {
-        previousSwitchState1 = switchState1;
-        m_driver1.send({ switchState1 });
+        throw std::invalid_argument(fmt::format(
+            "kc::Controller::getState(): Relay is unknown [relay: {}]",
+            relay
+        ));
     }
+    return { snapshot().mask.test(relay) };
+}
+
+Controller::Snapshot Controller::apply(const Mask& mask, const Mask& value)
+{
+    // Only writers change state words and they are serialized, so the current state is read without the sequence check
+    Snapshot previous;
+    uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+    previous.version = sequence / 2;
+    for (size_t index = 0; index < m_words; ++index)
+        previous.mask.setWord(index, m_state[index].load(std::memory_order_relaxed));
 
-    uint8_t switchState2 = static_cast<uint8_t>(switchState >> 8);
-    static uint8_t previousSwitchState2 = switchState2;
-    if (force || switchState2 != previousSwitchState2)
+    Mask relays = mask & m_allRelays;
+    Snapshot next = { previous.version + 1, (previous.mask & ~relays) | (value & relays) };
+    if (next.mask == previous.mask)
     {
-        previousSwitchState2 = switchState2;
-        m_driver2.send({ switchState2 });
+        // Cancelling a pulse may keep relays state, but it makes the relay journaled enabled
+        journal(previous);
+        return previous;
     }
+
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t index = 0; index < m_words; ++index)
+        m_state[index].store(next.mask.word(index), std::memory_order_relaxed);
+    m_sequence.store(sequence + 2, std::memory_order_release);
+
+    journal(next);
+
+    (previous.mask ^ next.mask).forEach([this](Relay relay) { m_toggles.add(relay); });
+    switchRelays();
+    return next;
 }
 
-Controller::Controller(Config::Pointer config)
-    : m_driver1(config->i2cPort(), 0x20)
-    , m_driver2(config->i2cPort(), 0x21)
+void Controller::journal(const Snapshot& snapshot)
 {
-    for (Relay relay = Relay::One; relay != Relay::MaxRelays; ++relay)
-        m_relays.emplace(relay, false);
-    switchRelays(true);
+    /*
+    *   Pulsing relays are journaled at their released state: releases aren't journaled,
+    *   so a restart while a relay is pulsing must find it released rather than latch it enabled.
+    */
+    if (!m_journal)
+        return;
+
+    Mask journaled = snapshot.mask & ~m_pulsing;
+    if (journaled == m_journaled)
+        return;
+
+    // Journaled versions must grow even when only the journaled state changes
+    m_journalVersion = std::max(snapshot.version, m_journalVersion + 1);
+    m_journal->append(m_journalVersion, m_journaled, journaled);
+    m_journaled = journaled;
 }
 
-Controller::~Controller()
+Controller::Snapshot Controller::update(const Mask& mask, const Mask& value)
 {
-    setAllStates(false);
+    std::lock_guard lock(m_updateMutex);
+    (m_pulsing & mask).forEach([this](Relay relay) { m_releases[relay] = NoRelease; });
+    m_pulsing &= ~mask;
+    return apply(mask, value);
 }
 
-Controller::State Controller::getState(Relay relay)
+Controller::Snapshot Controller::pulse(const Mask& mask, std::chrono::milliseconds duration)
 {
-    std::lock_guard lock(m_mutex);
-    auto relayEntry = m_relays.find(relay);
-    if (relayEntry == m_relays.end())
+    if (duration.count() <= 0 || duration > MaxPulse)
     {
         throw std::invalid_argument(fmt::format(
-            "kc::Controller::getState(): Relay is unknown [relay: {}]",
-            static_cast<int>(relay)
+            "kc::Controller::pulse(): Pulse duration is out of range [duration: {} ms]",
+            duration.count()
         ));
     }
-    return relayEntry->second;
+
+    std::lock_guard lock(m_updateMutex);
+    auto release = std::chrono::steady_clock::now() + duration;
+    Mask relays = mask & m_allRelays;
+    relays.forEach([this, release](Relay relay)
+    {
+        m_releases[relay] = release;
+        m_pulses.add(relay);
+    });
+    m_pulsing |= relays;
+
+    Snapshot snapshot = apply(relays, relays);
+    m_pulseCondition.notify_one();
+    return snapshot;
 }
 
 void Controller::setState(Relay relay, bool enabled)
 {
-    std::lock_guard lock(m_mutex);
-    auto relayEntry = m_relays.find(relay);
-    if (relayEntry == m_relays.end())
+    if (relay >= relays())
     {
         throw std::invalid_argument(fmt::format(
             "kc::Controller::setState(): Relay is unknown [relay: {}]",
-            static_cast<int>(relay)
+            relay
         ));
     }
 
-    if (relayEntry->second.enabled != enabled)
-    {
-        relayEntry->second.enabled = enabled;
-        switchRelays();
-    }
+    Mask mask;
+    mask.set(relay);
+    update(mask, enabled ? mask : Mask());
 }
 
 void Controller::setAllStates(bool enabled)
+{
+    update(m_allRelays, enabled ? m_allRelays : Mask());
+}
+
+void Controller::listen(Listener listener)
 {
     std::lock_guard lock(m_mutex);
-    for (Relay relay = Relay::One; relay != Relay::MaxRelays; ++relay)
-        m_relays[relay].enabled = enabled;
-    switchRelays();
+    m_listener = std::move(listener);
 }
 
-Controller::Relay& operator++(Controller::Relay& relay)
+bool Controller::flush()
 {
-    relay = static_cast<Controller::Relay>(static_cast<int>(relay) + 1);
-    return relay;
+    return m_output.wait(m_output.submitted());
+}
+
+void Controller::flush(OutputStage::Completion completion)
+{
+    m_output.wait(m_output.submitted(), std::move(completion));
+}
+
+void Controller::writeMetrics(std::string& metrics) const
+{
+    Metrics::WriteHeader(metrics, "loraine_relay_toggles_total", "Relay state changes", "counter");
+    for (Relay relay = 0; relay < relays(); ++relay)
+        fmt::format_to(std::back_inserter(metrics), "loraine_relay_toggles_total{{relay=\"{}\"}} {}\n", m_names[relay], m_toggles.value(relay));
+
+    Metrics::WriteHeader(metrics, "loraine_relay_pulses_total", "Relay pulses started", "counter");
+    for (Relay relay = 0; relay < relays(); ++relay)
+        fmt::format_to(std::back_inserter(metrics), "loraine_relay_pulses_total{{relay=\"{}\"}} {}\n", m_names[relay], m_pulses.value(relay));
+
+    // Lateness is labelled by board rather than by relay, so that hundreds of relays don't multiply histogram series
+    std::vector<std::string> devices;
+    for (const Board& board : m_boards)
+        devices.push_back(board.device);
+    m_releaseLateness.write(metrics, "loraine_relay_pulse_release_lateness_seconds", "Delay between scheduled and actual pulse release", "device", devices);
+    m_output.writeMetrics(metrics);
+    if (m_journal)
+        m_journal->writeMetrics(metrics);
 }
 
 } // namespace kc
@@ -0,0 +1,41 @@
+#include "handler_memory.hpp"
+
+namespace kc {
+
+HandlerMemory::HandlerMemory()
+{
+    for (std::atomic<bool>& used : m_used)
+        used.store(false, std::memory_order_relaxed);
+}
+
+void* HandlerMemory::allocate(size_t size)
+{
+    /*
+    *   Operations of a connection are mostly started on its strand,
+    *   but mutations hop through the controller strand, so blocks are claimed atomically.
+    */
+    if (size <= BlockSize)
+    {
+        for (size_t index = 0; index < BlocksCount; ++index)
+        {
+            if (!m_used[index].exchange(true, std::memory_order_acquire))
+                return m_blocks[index].storage;
+        }
+    }
+    return ::operator new(size);
+}
+
+void HandlerMemory::deallocate(void* pointer, size_t size)
+{
+    for (size_t index = 0; index < BlocksCount; ++index)
+    {
+        if (pointer == m_blocks[index].storage)
+        {
+            m_used[index].store(false, std::memory_order_release);
+            return;
+        }
+    }
+    ::operator delete(pointer, size);
+}
+
+} // namespace kc
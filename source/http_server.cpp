@@ -2,250 +2,1187 @@
 
 namespace kc {
 
-int HttpServer::Connection::GetIndentation(const std::string& query)
+HttpServer::Statistics::Statistics(const RouteTable& routes)
+    : m_routes(routes.resources())
+    , m_requests((routes.size() + 1) * (std::size(Statuses) + 1))
+    , m_durations(routes.size() + 1)
+    , m_connections(4)
+    , m_timeouts(3)
+    , m_rejections(3)
 {
-    if (query.find("pretty=true") == std::string::npos)
+    m_routes.push_back("unknown");
+}
+
+void HttpServer::Statistics::connectionOpened()
+{
+    m_connections.add(0);
+}
+
+void HttpServer::Statistics::connectionClosed()
+{
+    m_connections.add(1);
+}
+
+void HttpServer::Statistics::connectionCreated()
+{
+    m_connections.add(2);
+}
+
+void HttpServer::Statistics::connectionReused()
+{
+    m_connections.add(3);
+}
+
+void HttpServer::Statistics::timedOut(Phase phase)
+{
+    m_timeouts.add(static_cast<size_t>(phase));
+}
+
+void HttpServer::Statistics::rejected(Rejection reason)
+{
+    m_rejections.add(static_cast<size_t>(reason));
+}
+
+void HttpServer::Statistics::request(size_t route, unsigned status, std::chrono::nanoseconds duration)
+{
+    size_t statusIndex = 0;
+    while (statusIndex < std::size(Statuses) && Statuses[statusIndex] != status)
+        ++statusIndex;
+
+    m_requests.add(route * (std::size(Statuses) + 1) + statusIndex);
+    m_durations.observe(route, duration);
+}
+
+void HttpServer::Statistics::write(std::string& metrics) const
+{
+    Metrics::WriteHeader(metrics, "loraine_http_requests_total", "Handled HTTP requests", "counter");
+    for (size_t route = 0; route < m_routes.size(); ++route)
+    {
+        for (size_t statusIndex = 0; statusIndex <= std::size(Statuses); ++statusIndex)
+        {
+            uint64_t count = m_requests.value(route * (std::size(Statuses) + 1) + statusIndex);
+            if (count == 0)
+                continue;
+
+            std::string status = statusIndex < std::size(Statuses) ? std::to_string(Statuses[statusIndex]) : "other";
+            fmt::format_to(std::back_inserter(metrics), "loraine_http_requests_total{{route=\"{}\",status=\"{}\"}} {}\n",
+                m_routes[route], status, count);
+        }
+    }
+
+    m_durations.write(metrics, "loraine_http_request_duration_seconds", "HTTP request handling duration", "route", m_routes);
+
+    Metrics::WriteHeader(metrics, "loraine_http_active_connections", "Open HTTP connections", "gauge");
+    fmt::format_to(std::back_inserter(metrics), "loraine_http_active_connections {}\n",
+        static_cast<int64_t>(m_connections.value(0) - m_connections.value(1)));
+
+    Metrics::WriteHeader(metrics, "loraine_http_connections_created_total", "Connection objects created to accept connections", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_http_connections_created_total {}\n", m_connections.value(2));
+
+    Metrics::WriteHeader(metrics, "loraine_http_connections_reused_total", "Connection objects taken from pool to accept connections", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_http_connections_reused_total {}\n", m_connections.value(3));
+
+    Metrics::WriteHeader(metrics, "loraine_http_timeouts_total", "Connections closed for missing their deadline", "counter");
+    for (const auto& [phase, name] : { std::pair(Phase::Header, "header"), std::pair(Phase::Body, "body"), std::pair(Phase::Response, "response") })
+        fmt::format_to(std::back_inserter(metrics), "loraine_http_timeouts_total{{phase=\"{}\"}} {}\n", name, m_timeouts.value(static_cast<size_t>(phase)));
+
+    Metrics::WriteHeader(metrics, "loraine_http_rejected_total", "Requests rejected without routing and connections that couldn't be accepted", "counter");
+    for (const auto& [reason, name] : { std::pair(Rejection::Overload, "overload"), std::pair(Rejection::BodyTooLarge, "body_too_large"), std::pair(Rejection::AcceptFailed, "accept_failed") })
+        fmt::format_to(std::back_inserter(metrics), "loraine_http_rejected_total{{reason=\"{}\"}} {}\n", name, m_rejections.value(static_cast<size_t>(reason)));
+}
+
+void HttpServer::ConnectionPool::Recycler::operator()(Connection* connection) const
+{
+    pool->recycle(connection);
+}
+
+HttpServer::ConnectionPool::ConnectionPool(size_t capacity)
+    : m_capacity(capacity)
+    , m_open(0)
+    , m_closed(false)
+{
+    // A connection may hold a control block of its previous use until its new one is created
+    m_idle.reserve(m_capacity);
+    m_blocks.reserve(m_capacity * 2);
+}
+
+HttpServer::ConnectionPool::~ConnectionPool()
+{
+    // Idle connections release control blocks of their last use, so they are destroyed while blocks are still cached
+    m_idle.clear();
+}
+
+std::unique_ptr<HttpServer::Connection> HttpServer::ConnectionPool::take()
+{
+    std::lock_guard lock(m_mutex);
+    if (m_idle.empty())
+        return nullptr;
+
+    std::unique_ptr<Connection> connection = std::move(m_idle.back());
+    m_idle.pop_back();
+    return connection;
+}
+
+size_t HttpServer::ConnectionPool::open()
+{
+    return m_open.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void HttpServer::ConnectionPool::recycle(Connection* connection)
+{
+    std::unique_ptr<Connection> recycled(connection);
+    recycled->close();
+    m_open.fetch_sub(1, std::memory_order_relaxed);
+
+    std::unique_lock lock(m_mutex);
+    if (!m_closed && m_idle.size() < m_capacity)
+    {
+        m_idle.push_back(std::move(recycled));
+        return;
+    }
+
+    // Connection that doesn't fit is destroyed outside the lock, as it may release its control block to the pool
+    lock.unlock();
+    recycled.reset();
+}
+
+void HttpServer::ConnectionPool::close()
+{
+    std::vector<std::unique_ptr<Connection>> idle;
+    {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+        idle.swap(m_idle);
+    }
+
+    // Connections are destroyed outside the lock, as they release their control blocks to the pool
+    idle.clear();
+}
+
+void* HttpServer::ConnectionPool::allocate(size_t size)
+{
+    if (size <= BlockSize)
+    {
+        std::lock_guard lock(m_mutex);
+        if (!m_blocks.empty())
+        {
+            Block* block = m_blocks.back().release();
+            m_blocks.pop_back();
+            return block->storage;
+        }
+    }
+    return size <= BlockSize ? (new Block)->storage : ::operator new(size);
+}
+
+void HttpServer::ConnectionPool::deallocate(void* pointer, size_t size)
+{
+    if (size > BlockSize)
+    {
+        ::operator delete(pointer, size);
+        return;
+    }
+
+    std::unique_ptr<Block> block(reinterpret_cast<Block*>(pointer));
+    std::lock_guard lock(m_mutex);
+    if (m_blocks.size() < m_blocks.capacity())
+        m_blocks.push_back(std::move(block));
+}
+
+HttpServer::Routes HttpServer::Connection::CreateRoutes()
+{
+    auto routes = std::make_shared<RouteTable>();
+    routes->add("/relays", beast::http::verb::get, [](Connection& connection, int indentation)
+    {
+        connection.getRelays(indentation);
+    });
+    routes->add("/relays", beast::http::verb::post, [](Connection& connection, int indentation)
+    {
+        connection.postRelays(indentation);
+    });
+    routes->add("/relays", beast::http::verb::patch, [](Connection& connection, int indentation)
+    {
+        connection.patchRelays(indentation);
+    });
+    routes->add("/relays/events", beast::http::verb::get, [](Connection& connection, int indentation)
+    {
+        connection.getEvents(indentation);
+    });
+    routes->add("/metrics", beast::http::verb::get, [](Connection& connection, int indentation)
+    {
+        connection.getMetrics(indentation);
+    });
+    routes->add("/schedules", beast::http::verb::get, [](Connection& connection, int indentation)
+    {
+        connection.getSchedules(indentation);
+    });
+    routes->add("/schedules", beast::http::verb::post, [](Connection& connection, int indentation)
+    {
+        connection.postSchedules(indentation);
+    });
+    routes->add("/schedules/*", beast::http::verb::get, [](Connection& connection, int indentation)
+    {
+        connection.getSchedule(indentation);
+    });
+    routes->add("/schedules/*", beast::http::verb::delete_, [](Connection& connection, int indentation)
+    {
+        connection.deleteSchedule(indentation);
+    });
+
+    // A single route serves all relays however many are configured, relays are found by the controller's name index
+    routes->add("/relays/*", beast::http::verb::get, [](Connection& connection, int indentation)
+    {
+        connection.getRelay(indentation);
+    });
+    routes->add("/relays/*", beast::http::verb::post, [](Connection& connection, int indentation)
+    {
+        connection.postRelay(indentation);
+    });
+    return routes;
+}
+
+int HttpServer::Connection::GetIndentation(std::string_view query)
+{
+    if (query.find("pretty=true") == std::string_view::npos)
         return -1;
     return 4;
 }
 
-HttpServer::Connection::Target HttpServer::Connection::ParseTarget(const std::string& target)
+bool HttpServer::Connection::GetWait(std::string_view query)
+{
+    return query.find("wait=true") != std::string_view::npos;
+}
+
+HttpServer::Connection::Target HttpServer::Connection::ParseTarget(std::string_view target)
 {
-    size_t queryStartPosition = target.find("?");
-    if (queryStartPosition == std::string::npos)
+    size_t queryStartPosition = target.find('?');
+    if (queryStartPosition == std::string_view::npos)
         return { target, {} };
-    return { target.substr(0, queryStartPosition), std::string(target.begin() + queryStartPosition + 1, target.end()) };
+    return { target.substr(0, queryStartPosition), target.substr(queryStartPosition + 1) };
+}
+
+void HttpServer::Connection::ParseUpdate(const Controller& controller, const json& requestJson, Controller::Mask& mask, Controller::Mask& value)
+{
+    /*
+    *   Accepted bodies:
+    *   {"set": ["<relay>", ...], "clear": ["<relay>", ...]} where both arrays are optional, or
+    *   {"mask": <mask>, "value": <value>} where bit N stands for relay N, which only reaches the first 64 relays.
+    */
+    mask = {};
+    value = {};
+    if (requestJson.contains("mask"))
+    {
+        mask = Controller::Mask::FromBits(requestJson["mask"].get<uint64_t>());
+        value = Controller::Mask::FromBits(requestJson["value"].get<uint64_t>());
+        if (((mask | value) & ~controller.allRelays()).any())
+            throw std::invalid_argument("Mask addresses unknown relays");
+        return;
+    }
+
+    auto addRelays = [&controller, &requestJson, &mask, &value](const char* operation, bool enabled)
+    {
+        for (const json& uniqueName : requestJson.value(operation, json::array()))
+        {
+            std::optional<Controller::Relay> relay = controller.find(uniqueName.get<std::string>());
+            if (!relay)
+                throw std::invalid_argument("Relay is unknown");
+            // Listing a relay twice in the same array changes nothing, only contradicting lists are rejected
+            if (mask.test(*relay) && value.test(*relay) != enabled)
+                throw std::invalid_argument("Relay is both set and cleared");
+
+            mask.set(*relay);
+            value.set(*relay, enabled);
+        }
+    };
+    addRelays("set", true);
+    addRelays("clear", false);
+}
+
+json HttpServer::Connection::JobJson(const Controller& controller, const Scheduler::Job& job)
+{
+    // Deadlines are kept on the steady clock and are only converted to wall clock time for clients
+    auto next = std::chrono::system_clock::now() + std::chrono::duration_cast<std::chrono::system_clock::duration>(job.deadline - Scheduler::Clock::now());
+
+    json jobJson;
+    jobJson["id"] = job.id;
+    jobJson["set"] = json::array();
+    jobJson["clear"] = json::array();
+    job.mask.forEach([&controller, &job, &jobJson](Controller::Relay relay)
+    {
+        jobJson[job.value.test(relay) ? "set" : "clear"].push_back(controller.uniqueName(relay));
+    });
+    jobJson["next"] = std::chrono::duration_cast<std::chrono::milliseconds>(next.time_since_epoch()).count();
+    jobJson["interval"] = job.interval.count();
+    jobJson["runs"] = job.runs;
+    return jobJson;
+}
+
+bool HttpServer::Connection::GetEnabled(std::string_view body)
+{
+    /*
+    *   Bodies like {"enabled": true} are matched without building a JSON document.
+    *   Anything else goes through the full parser, which accepts and rejects the same bodies as before.
+    */
+    size_t position = 0;
+    auto skipWhitespace = [&body, &position]()
+    {
+        while (position < body.size() && (body[position] == ' ' || body[position] == '\t' || body[position] == '\r' || body[position] == '\n'))
+            ++position;
+    };
+    auto consume = [&body, &position, &skipWhitespace](std::string_view token)
+    {
+        skipWhitespace();
+        if (body.substr(position, token.size()) != token)
+            return false;
+        position += token.size();
+        return true;
+    };
+
+    if (consume("{") && consume("\"enabled\"") && consume(":"))
+    {
+        std::optional<bool> enabled;
+        if (consume("true"))
+            enabled = true;
+        else if (consume("false"))
+            enabled = false;
+
+        if (enabled && consume("}"))
+        {
+            skipWhitespace();
+            if (position == body.size())
+                return *enabled;
+        }
+    }
+
+    json requestJson = json::parse(body);
+    return requestJson["enabled"].get<bool>();
+}
+
+std::optional<std::chrono::milliseconds> HttpServer::Connection::GetPulse(std::string_view body)
+{
+    // Only bodies that mention a pulse are parsed here, so plain switching keeps its fast path
+    if (body.find("\"pulse_ms\"") == std::string_view::npos)
+        return {};
+
+    json requestJson = json::parse(body);
+    if (!requestJson.is_object() || !requestJson.contains("pulse_ms") || requestJson.contains("enabled"))
+        throw std::invalid_argument("Body is not a pulse request");
+    return std::chrono::milliseconds(requestJson["pulse_ms"].get<int64_t>());
+}
+
+void HttpServer::Connection::resetMessages()
+{
+    /*
+    *   Messages are destroyed before their arena is reset and re-created in it.
+    *   Response body storage is moved between messages, so its capacity is kept across requests.
+    */
+    std::string body;
+    if (m_response)
+    {
+        body = std::move(m_response->body());
+        body.clear();
+    }
+
+    m_parser.reset();
+    m_response.reset();
+    m_arena.reset();
+
+    ArenaAllocator<char> allocator(m_arena);
+    m_parser.emplace(std::piecewise_construct, std::make_tuple(allocator), std::make_tuple(allocator));
+    m_response.emplace(std::piecewise_construct, std::make_tuple(std::move(body)), std::make_tuple(allocator));
+}
+
+void HttpServer::Connection::log(spdlog::level::level_enum level, const char* message)
+{
+    m_requestLog->log(level, request().method(), { request().target().data(), request().target().size() }, m_response->result_int(), m_address, message);
 }
 
 void HttpServer::Connection::notFound()
 {
-    m_response.result(beast::http::status::not_found);
-    m_response.set(beast::http::field::content_type, "text/plain");
-    beast::ostream(m_response.body()) << "Resource not found\n";
-    m_logger->error(m_logMessage("Not found"));
+    m_response->result(beast::http::status::not_found);
+    m_response->set(beast::http::field::content_type, "text/plain");
+    m_response->body().append("Resource not found\n");
+    log(spdlog::level::err, "Not found");
 }
 
 void HttpServer::Connection::methodNotAllowed()
 {
-    m_response.result(beast::http::status::method_not_allowed);
-    m_response.set(beast::http::field::content_type, "text/plain");
-    beast::ostream(m_response.body()) << "This method is not allowed\n";
-    m_logger->error(m_logMessage("Method Not Allowed"));
+    m_response->result(beast::http::status::method_not_allowed);
+    m_response->set(beast::http::field::content_type, "text/plain");
+    m_response->body().append("This method is not allowed\n");
+    log(spdlog::level::err, "Method Not Allowed");
 }
 
-void HttpServer::Connection::getRelays(int indentation)
+void HttpServer::Connection::badRequest()
+{
+    m_response->result(beast::http::status::bad_request);
+    m_response->set(beast::http::field::content_type, "text/plain");
+    m_response->body().append("Bad request\n");
+    log(spdlog::level::err, "Bad request");
+}
+
+void HttpServer::Connection::writeFailed()
+{
+    m_response->result(beast::http::status::internal_server_error);
+    m_response->set(beast::http::field::content_type, "text/plain");
+    m_response->body().clear();
+    m_response->body().append("Couldn't write relays state\n");
+    log(spdlog::level::err, "Couldn't write relays state");
+}
+
+void HttpServer::Connection::reject(Rejection reason)
 {
-    json responseJson;
-    for (Controller::Relay relay = Controller::Relay::One; relay != Controller::Relay::MaxRelays; ++relay)
+    // Rejected requests aren't routed and their connection is closed, so the client can't keep holding it
+    m_requestStart = std::chrono::steady_clock::now();
+    setDeadline(Phase::Response, m_config->httpTimeout());
+    m_route = m_routes->size();
+    m_response->version(request().version());
+    m_response->keep_alive(false);
+    m_response->set(beast::http::field::content_type, "text/plain");
+    m_statistics->rejected(reason);
+    if (reason == Rejection::Overload)
+    {
+        m_response->result(beast::http::status::service_unavailable);
+        m_response->set(beast::http::field::retry_after, "1");
+        m_response->body().append("Server is overloaded\n");
+        log(spdlog::level::warn, "Overloaded");
+    }
+    else
     {
-        json stateJson;
-        stateJson["enabled"] = m_controller->getState(relay).enabled;
-        responseJson[Controller::UniqueName(relay)] = stateJson;
+        m_response->result(beast::http::status::payload_too_large);
+        m_response->body().append("Request body is too large\n");
+        log(spdlog::level::err, "Request body is too large");
     }
+}
 
-    m_response.result(beast::http::status::ok);
-    m_response.set(beast::http::field::content_type, "application/json");
-    beast::ostream(m_response.body()) << responseJson.dump(indentation) << '\n';
-    m_logger->info(m_logMessage("OK"));
+void HttpServer::Connection::getRelays(int indentation)
+{
+    m_response->result(beast::http::status::ok);
+    m_response->set(beast::http::field::content_type, "application/json");
+    m_stateCache->relays(m_response->body(), indentation != -1);
+    log(spdlog::level::info, "OK");
 }
 
 void HttpServer::Connection::postRelays(int indentation)
 {
     try
     {
-        json requestJson = json::parse(beast::buffers_to_string(m_request.body().data()));
-        m_controller->setAllStates(requestJson["enabled"]);
+        bool enabled = GetEnabled({ request().body().data(), request().body().size() });
+        m_controller->setAllStates(enabled);
 
-        json responseJson;
-        for (Controller::Relay relay = Controller::Relay::One; relay != Controller::Relay::MaxRelays; ++relay)
+        m_response->result(beast::http::status::ok);
+        m_response->set(beast::http::field::content_type, "application/json");
+        StateCache::Serialize(m_response->body(), *m_controller, enabled ? m_controller->allRelays() : Controller::Mask(), m_controller->allRelays(), indentation != -1);
+        m_response->body().push_back('\n');
+        log(spdlog::level::info, "OK");
+    }
+    catch (const json::exception&)
+    {
+        badRequest();
+    }
+}
+
+void HttpServer::Connection::patchRelays(int indentation)
+{
+    try
+    {
+        json requestJson = json::parse(std::string_view(request().body().data(), request().body().size()));
+        Controller::Mask mask, value;
+        ParseUpdate(*m_controller, requestJson, mask, value);
+
+        Controller::Snapshot snapshot = m_controller->update(mask, value);
+        m_response->result(beast::http::status::ok);
+        m_response->set(beast::http::field::content_type, "application/json");
+        StateCache::Serialize(m_response->body(), *m_controller, snapshot.mask, m_controller->allRelays(), indentation != -1);
+        m_response->body().push_back('\n');
+        log(spdlog::level::info, "OK");
+    }
+    catch (const json::exception&)
+    {
+        badRequest();
+    }
+    catch (const std::invalid_argument&)
+    {
+        badRequest();
+    }
+}
+
+void HttpServer::Connection::getEvents(int indentation)
+{
+    // The response is streamed by relay events once the socket is handed over to them
+    boost::ignore_unused(indentation);
+    m_response->result(beast::http::status::ok);
+    m_subscribing = true;
+    log(spdlog::level::info, "OK");
+}
+
+void HttpServer::Connection::getMetrics(int indentation)
+{
+    boost::ignore_unused(indentation);
+    std::string metrics;
+    m_statistics->write(metrics);
+    m_controller->writeMetrics(metrics);
+    m_events->writeMetrics(metrics);
+    if (m_control)
+        m_control->writeMetrics(metrics);
+    m_scheduler->writeMetrics(metrics);
+    m_requestLog->writeMetrics(metrics);
+
+    m_response->result(beast::http::status::ok);
+    m_response->set(beast::http::field::content_type, "text/plain; version=0.0.4");
+    m_response->body().append(metrics);
+    log(spdlog::level::info, "OK");
+}
+
+void HttpServer::Connection::getSchedules(int indentation)
+{
+    json responseJson = json::array();
+    for (const Scheduler::Job& job : m_scheduler->jobs())
+        responseJson.push_back(JobJson(*m_controller, job));
+
+    m_response->result(beast::http::status::ok);
+    m_response->set(beast::http::field::content_type, "application/json");
+    m_response->body().append(responseJson.dump(indentation));
+    m_response->body().push_back('\n');
+    log(spdlog::level::info, "OK");
+}
+
+void HttpServer::Connection::postSchedules(int indentation)
+{
+    try
+    {
+        /*
+        *   Accepted bodies are relays updates accepted by "/relays" PATCH with timing in milliseconds:
+        *   {"at": <Unix time>} or {"delay": <delay>} for the first run, and optional {"interval": <interval>} for recurring jobs.
+        *   A recurring job without the first run time first runs one interval from now.
+        */
+        json requestJson = json::parse(std::string_view(request().body().data(), request().body().size()));
+        Controller::Mask mask, value;
+        ParseUpdate(*m_controller, requestJson, mask, value);
+        if (mask.none())
+            throw std::invalid_argument("Job changes no relays");
+
+        // Timing is bounded before any arithmetic is done on it, so that no value can overflow into a past deadline
+        std::chrono::milliseconds interval(requestJson.value("interval", int64_t(0)));
+        if (interval.count() != 0 && (interval < Scheduler::MinInterval || interval > Scheduler::MaxHorizon))
+            throw std::invalid_argument("Interval is out of range");
+
+        Scheduler::Clock::time_point now = Scheduler::Clock::now(), deadline;
+        if (requestJson.contains("at") && requestJson.contains("delay"))
+            throw std::invalid_argument("Both time and delay of the first run are given");
+        if (requestJson.contains("at"))
         {
-            json stateJson;
-            stateJson["enabled"] = requestJson["enabled"];
-            responseJson[Controller::UniqueName(relay)] = stateJson;
+            std::chrono::milliseconds atTime(requestJson["at"].get<int64_t>());
+            auto wallNow = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+            if (atTime < wallNow - Scheduler::MaxHorizon || atTime > wallNow + Scheduler::MaxHorizon)
+                throw std::invalid_argument("Time of the first run is out of range");
+
+            std::chrono::system_clock::time_point at(atTime);
+            deadline = now + std::chrono::duration_cast<Scheduler::Clock::duration>(at - std::chrono::system_clock::now());
+        }
+        else if (requestJson.contains("delay"))
+        {
+            std::chrono::milliseconds delay(requestJson["delay"].get<int64_t>());
+            if (delay.count() < 0 || delay > Scheduler::MaxHorizon)
+                throw std::invalid_argument("Delay is out of range");
+            deadline = now + delay;
         }
+        else if (interval.count() != 0)
+            deadline = now + interval;
+        else
+            throw std::invalid_argument("Time of the first run is not given");
 
-        m_response.result(beast::http::status::ok);
-        m_response.set(beast::http::field::content_type, "application/json");
-        beast::ostream(m_response.body()) << responseJson.dump(indentation) << '\n';
-        m_logger->info(m_logMessage("OK"));
+        Scheduler::Job job;
+        if (m_scheduler->add(mask, value, deadline, interval, job) == Scheduler::AddResult::Full)
+        {
+            m_response->result(beast::http::status::service_unavailable);
+            m_response->set(beast::http::field::content_type, "text/plain");
+            m_response->body().append("Too many scheduled jobs\n");
+            log(spdlog::level::err, "Too many scheduled jobs");
+            return;
+        }
+
+        m_response->result(beast::http::status::ok);
+        m_response->set(beast::http::field::content_type, "application/json");
+        m_response->body().append(JobJson(*m_controller, job).dump(indentation));
+        m_response->body().push_back('\n');
+        log(spdlog::level::info, "OK");
     }
     catch (const json::exception&)
     {
-        m_response.result(beast::http::status::bad_request);
-        m_response.set(beast::http::field::content_type, "text/plain");
-        beast::ostream(m_response.body()) << "Bad request\n";
-        m_logger->error(m_logMessage("Bad request"));
+        badRequest();
+    }
+    catch (const std::invalid_argument&)
+    {
+        badRequest();
     }
 }
 
-void HttpServer::Connection::getRelay(Controller::Relay relay, int indentation)
+void HttpServer::Connection::getSchedule(int indentation)
 {
-    json responseJson, stateJson;
-    stateJson["enabled"] = m_controller->getState(relay).enabled;
-    responseJson[Controller::UniqueName(relay)] = stateJson;
+    uint64_t id = 0;
+    std::optional<Scheduler::Job> job;
+    auto [end, error] = std::from_chars(m_routeParameter.data(), m_routeParameter.data() + m_routeParameter.size(), id);
+    if (error == std::errc() && end == m_routeParameter.data() + m_routeParameter.size())
+        job = m_scheduler->get(id);
+    if (!job)
+    {
+        notFound();
+        return;
+    }
 
-    m_response.result(beast::http::status::ok);
-    m_response.set(beast::http::field::content_type, "application/json");
-    beast::ostream(m_response.body()) << responseJson.dump(indentation) << '\n';
-    m_logger->info(m_logMessage("OK"));
+    m_response->result(beast::http::status::ok);
+    m_response->set(beast::http::field::content_type, "application/json");
+    m_response->body().append(JobJson(*m_controller, *job).dump(indentation));
+    m_response->body().push_back('\n');
+    log(spdlog::level::info, "OK");
 }
 
-void HttpServer::Connection::postRelay(Controller::Relay relay, int indentation)
+void HttpServer::Connection::deleteSchedule(int indentation)
 {
-    try
+    uint64_t id = 0;
+    std::optional<Scheduler::Job> job;
+    auto [end, error] = std::from_chars(m_routeParameter.data(), m_routeParameter.data() + m_routeParameter.size(), id);
+    if (error == std::errc() && end == m_routeParameter.data() + m_routeParameter.size())
+        job = m_scheduler->remove(id);
+    if (!job)
     {
-        json requestJson = json::parse(beast::buffers_to_string(m_request.body().data()));
-        m_controller->setState(relay, requestJson["enabled"]);
+        notFound();
+        return;
+    }
 
-        json responseJson, stateJson;
-        stateJson["enabled"] = requestJson["enabled"];
-        responseJson[Controller::UniqueName(relay)] = stateJson;
+    m_response->result(beast::http::status::ok);
+    m_response->set(beast::http::field::content_type, "application/json");
+    m_response->body().append(JobJson(*m_controller, *job).dump(indentation));
+    m_response->body().push_back('\n');
+    log(spdlog::level::info, "OK");
+}
 
-        m_response.result(beast::http::status::ok);
-        m_response.set(beast::http::field::content_type, "text/plain");
-        beast::ostream(m_response.body()) << responseJson.dump(indentation) << '\n';
-        m_logger->info(m_logMessage("OK"));
+void HttpServer::Connection::getRelay(int indentation)
+{
+    std::optional<Controller::Relay> relay = m_controller->find(m_routeParameter);
+    if (!relay)
+    {
+        notFound();
+        return;
+    }
+
+    Controller::Mask relays;
+    relays.set(*relay);
+    m_response->result(beast::http::status::ok);
+    m_response->set(beast::http::field::content_type, "application/json");
+    StateCache::Serialize(m_response->body(), *m_controller, m_controller->snapshot().mask, relays, indentation != -1);
+    m_response->body().push_back('\n');
+    log(spdlog::level::info, "OK");
+}
+
+void HttpServer::Connection::postRelay(int indentation)
+{
+    std::optional<Controller::Relay> relay = m_controller->find(m_routeParameter);
+    if (!relay)
+    {
+        notFound();
+        return;
+    }
+
+    try
+    {
+        std::string_view body(request().body().data(), request().body().size());
+        Controller::Mask relays;
+        relays.set(*relay);
+        bool enabled = true;
+        if (std::optional<std::chrono::milliseconds> pulse = GetPulse(body))
+            m_controller->pulse(relays, *pulse);
+        else
+        {
+            enabled = GetEnabled(body);
+            m_controller->setState(*relay, enabled);
+        }
+
+        m_response->result(beast::http::status::ok);
+        m_response->set(beast::http::field::content_type, "text/plain");
+        StateCache::Serialize(m_response->body(), *m_controller, enabled ? relays : Controller::Mask(), relays, indentation != -1);
+        m_response->body().push_back('\n');
+        log(spdlog::level::info, "OK");
     }
     catch (const json::exception&)
     {
-        m_response.result(beast::http::status::bad_request);
-        m_response.set(beast::http::field::content_type, "text/plain");
-        beast::ostream(m_response.body()) << "Bad request\n";
-        m_logger->error(m_logMessage("Bad request"));
+        badRequest();
+    }
+    catch (const std::invalid_argument&)
+    {
+        badRequest();
     }
 }
 
 void HttpServer::Connection::produceResponse()
 {
-    m_response.version(m_request.version());
-    m_response.keep_alive(false);
+    m_flushing = false;
+    m_response->version(request().version());
+    m_response->keep_alive(request().keep_alive() && m_requests < m_config->httpMaxRequests());
 
-    Target target = ParseTarget({ m_request.target().data(), m_request.target().size() });
-    int indentation = GetIndentation(target.query);
-    if (target.resource == "/relays")
+    Target target = ParseTarget({ request().target().data(), request().target().size() });
+    RouteTable::Match match = m_routes->find(target.resource, request().method());
+    m_route = match.resource;
+    m_routeParameter = match.parameter;
+    switch (match.status)
     {
-        if (m_request.method() == beast::http::verb::get)
-        {
-            getRelays(indentation);
+        case RouteTable::Status::Found:
+            (*match.handler)(*this, GetIndentation(target.query));
+            m_flushing = request().method() != beast::http::verb::get && m_response->result() == beast::http::status::ok && GetWait(target.query);
             return;
-        }
+        case RouteTable::Status::MethodNotAllowed:
+            methodNotAllowed();
+            return;
+        default:
+            notFound();
+            return;
+    }
+}
 
-        if (m_request.method() == beast::http::verb::post)
+void HttpServer::Connection::sendResponse()
+{
+    auto self = shared_from_this();
+    m_response->content_length(m_response->body().size());
+    beast::http::async_write(m_socket, *m_response, BindHandler(m_handlerMemory, [self](beast::error_code error, std::size_t bytesTransferred)
+    {
+        boost::ignore_unused(bytesTransferred);
+        self->m_statistics->request(self->m_route, self->m_response->result_int(), std::chrono::steady_clock::now() - self->m_requestStart);
+        if (error || !self->m_response->keep_alive())
         {
-            postRelays(indentation);
+            self->m_socket.shutdown(Socket::shutdown_send, error);
+            self->m_timeout.cancel();
             return;
         }
 
-        methodNotAllowed();
-        return;
-    }
+        self->handleRequest();
+    }));
+}
 
-    for (Controller::Relay relay = Controller::Relay::One; relay != Controller::Relay::MaxRelays; ++relay)
+HttpServer::Connection::Coroutine HttpServer::Connection::serve()
+{
+    /*
+    *   The keep-alive loop lives in a single coroutine frame for the whole connection, so handling a request
+    *   doesn't create a handler per step. A passed deadline closes the socket, which cancels the operation
+    *   the coroutine is suspended on and resumes it with an error.
+    */
+    beast::error_code error;
+    while (true)
     {
-        if (target.resource == fmt::format("/relays/{}", Controller::UniqueName(relay)))
+        setDeadline(Phase::Header, m_requests == 0 ? m_config->httpHeaderTimeout() : m_config->httpIdleTimeout());
+        resetMessages();
+        m_parser->body_limit(m_config->httpMaxBody());
+        co_await beast::http::async_read_header(m_socket, m_buffer, *m_parser, BindToken(m_handlerMemory, asio::redirect_error(UseAwaitable(), error)));
+        if (error && error != beast::http::error::body_limit)
+            break;
+        ++m_requests;
+
+        // Body of a request that is rejected already isn't read
+        if (!error && !m_overloaded && !m_parser->is_done())
         {
-            if (m_request.method() == beast::http::verb::get)
+            setDeadline(Phase::Body, m_config->httpBodyTimeout());
+            co_await beast::http::async_read(m_socket, m_buffer, *m_parser, BindToken(m_handlerMemory, asio::redirect_error(UseAwaitable(), error)));
+            if (error && error != beast::http::error::body_limit)
+                break;
+        }
+
+        if (error)
+            reject(Rejection::BodyTooLarge);
+        else if (m_overloaded)
+            reject(Rejection::Overload);
+        else
+        {
+            m_requestStart = std::chrono::steady_clock::now();
+            setDeadline(Phase::Response, m_config->httpTimeout());
+            if (request().method() == beast::http::verb::get)
             {
-                getRelay(relay, indentation);
-                return;
+                produceResponse();
+                if (m_subscribing)
+                {
+                    m_timeout.cancel();
+                    m_statistics->request(m_route, m_response->result_int(), std::chrono::steady_clock::now() - m_requestStart);
+                    m_events->subscribe(request().version(), std::move(m_socket));
+                    co_return;
+                }
             }
-
-            if (m_request.method() == beast::http::verb::post)
+            else
             {
-                postRelay(relay, indentation);
-                return;
+                // Mutations are produced on the controller strand, the coroutine is resumed on its own strand afterwards
+                bool written = co_await asio::async_initiate<const UseAwaitable&, void(bool)>([this](auto resume)
+                {
+                    asio::post(m_controllerStrand, BindHandler(m_handlerMemory, [this, resume = std::move(resume)]() mutable
+                    {
+                        produceResponse();
+                        if (!m_flushing)
+                        {
+                            asio::post(m_socket.get_executor(), BindHandler(m_handlerMemory, [resume = std::move(resume)]() mutable { resume(true); }));
+                            return;
+                        }
+
+                        // Completion must be copyable, so the coroutine's handler is shared by its copies
+                        auto shared = std::make_shared<decltype(resume)>(std::move(resume));
+                        m_controller->flush([this, shared](bool success)
+                        {
+                            asio::post(m_socket.get_executor(), BindHandler(m_handlerMemory, [shared, success]() { (*shared)(success); }));
+                        });
+                    }));
+                }, UseAwaitable());
+                if (!written)
+                    writeFailed();
             }
+        }
 
-            methodNotAllowed();
-            return;
+        m_response->content_length(m_response->body().size());
+        co_await beast::http::async_write(m_socket, *m_response, BindToken(m_handlerMemory, asio::redirect_error(UseAwaitable(), error)));
+        m_statistics->request(m_route, m_response->result_int(), std::chrono::steady_clock::now() - m_requestStart);
+        if (error || !m_response->keep_alive())
+        {
+            m_socket.shutdown(Socket::shutdown_send, error);
+            break;
         }
     }
-
-    notFound();
-    return;
+    m_timeout.cancel();
 }
 
-void HttpServer::Connection::sendResponse()
+void HttpServer::Connection::Start(std::unique_ptr<Connection> connection, const asio::ip::address& address, ConnectionPool& pool, bool overloaded)
 {
-    auto self = shared_from_this();
-    m_response.content_length(m_response.body().size());
-    beast::http::async_write(m_socket, m_response, [self](beast::error_code error, std::size_t bytesTransferred)
+    connection->m_address = address;
+    connection->m_requests = 0;
+    connection->m_waiting = false;
+    connection->m_overloaded = overloaded;
+    connection->m_subscribing = false;
+    connection->m_statistics->connectionOpened();
+
+    // Connection is shared by its pending handlers and returns to the pool when the last of them completes
+    std::shared_ptr<Connection> self(connection.release(), ConnectionPool::Recycler{ &pool }, ConnectionPool::Allocator<Connection>(pool));
+    if (self->m_config->httpPipeline() == Config::HttpPipeline::Callback)
     {
-        self->m_socket.shutdown(asio::ip::tcp::socket::shutdown_send, error);
-        self->m_timeout.cancel();
+        self->handleRequest();
+        return;
+    }
+
+    // Connection is kept by the spawned function object until the coroutine completes, its exceptions stop the server like handlers' ones do
+    asio::co_spawn(self->m_socket.get_executor(), [self]() { return self->serve(); }, [](std::exception_ptr exception)
+    {
+        if (exception)
+            std::rethrow_exception(exception);
     });
 }
 
-HttpServer::Connection::Connection(Logger logger, Config::Pointer config, Controller::Pointer controller, asio::ip::tcp::socket& socket)
-    : m_logger(logger)
+HttpServer::Connection::Connection(RequestLog::Pointer requestLog, Config::Pointer config, Controller::Pointer controller, StateCache::Pointer stateCache, RelayEvents::Pointer events, ControlServer::Pointer control, Scheduler::Pointer scheduler, Routes routes, Statistics::Pointer statistics, Strand controllerStrand, Strand strand)
+    : m_requestLog(requestLog)
     , m_config(config)
     , m_controller(controller)
-    , m_socket(std::move(socket))
+    , m_stateCache(stateCache)
+    , m_events(events)
+    , m_control(control)
+    , m_scheduler(scheduler)
+    , m_routes(routes)
+    , m_statistics(statistics)
+    , m_controllerStrand(controllerStrand)
+    , m_socket(strand)
     , m_buffer(1024 * 8)
-    , m_timeout(m_socket.get_executor(), std::chrono::seconds(10))
-{
-    m_logMessage = [this](const std::string& message)
-    {
-        return fmt::format(
-            "{} {} from {}: {} {}",
-            std::string(m_request.method_string()),
-            std::string(m_request.target()),
-            m_socket.remote_endpoint().address().to_string(),
-            m_response.result_int(),
-            message
-        );
-    };
+    , m_arena(ArenaCapacity)
+    , m_timeout(strand)
+    , m_requests(0)
+    , m_route(0)
+    , m_phase(Phase::Header)
+    , m_waiting(false)
+    , m_overloaded(false)
+    , m_subscribing(false)
+    , m_flushing(false)
+{}
 
-    m_timeout.async_wait([this](beast::error_code error)
+void HttpServer::Connection::close()
+{
+    // Socket of a subscribed connection was handed over to its event stream and is closed already
+    beast::error_code error;
+    if (m_socket.is_open())
+        m_socket.close(error);
+
+    // Pipelined data of the closed connection must not reach the next one, but buffer storage is kept
+    m_buffer.clear();
+    m_statistics->connectionClosed();
+}
+
+void HttpServer::Connection::setDeadline(Phase phase, std::chrono::seconds timeout)
+{
+    /*
+    *   A single wait is kept pending for the whole connection and is re-armed only when the deadline moves earlier,
+    *   so moving between phases doesn't start and cancel a wait every time.
+    */
+    m_phase = phase;
+    m_deadline = std::chrono::steady_clock::now() + timeout;
+    if (!m_waiting || m_deadline < m_timeout.expiry())
     {
-        if (!error)
-            m_socket.close(error);
-    });
+        m_timeout.expires_at(m_deadline);
+        waitDeadline();
+    }
+}
+
+void HttpServer::Connection::waitDeadline()
+{
+    m_waiting = true;
+    auto self = shared_from_this();
+    m_timeout.async_wait(BindHandler(m_handlerMemory, [self](beast::error_code error)
+    {
+        if (error)
+            return;
+
+        // Deadline moved later while the wait was pending
+        if (std::chrono::steady_clock::now() < self->m_deadline)
+        {
+            self->m_timeout.expires_at(self->m_deadline);
+            self->waitDeadline();
+            return;
+        }
+
+        self->m_statistics->timedOut(self->m_phase);
+        self->m_socket.close(error);
+    }));
+}
+
+void HttpServer::Connection::dispatchRequest()
+{
+    m_requestStart = std::chrono::steady_clock::now();
+    setDeadline(Phase::Response, m_config->httpTimeout());
+
+    if (request().method() == beast::http::verb::get)
+    {
+        produceResponse();
+        if (m_subscribing)
+        {
+            m_timeout.cancel();
+            m_statistics->request(m_route, m_response->result_int(), std::chrono::steady_clock::now() - m_requestStart);
+            m_events->subscribe(request().version(), std::move(m_socket));
+            return;
+        }
+
+        sendResponse();
+        return;
+    }
+
+    /*
+    *   Requests that may mutate controller state are produced on the controller strand
+    *   so that mutations are applied strictly in the order they arrive.
+    */
+    auto self = shared_from_this();
+    asio::post(m_controllerStrand, BindHandler(m_handlerMemory, [self]()
+    {
+        self->produceResponse();
+        if (!self->m_flushing)
+        {
+            asio::post(self->m_socket.get_executor(), BindHandler(self->m_handlerMemory, [self]() { self->sendResponse(); }));
+            return;
+        }
+
+        // Drivers are waited for without holding the controller strand or a worker thread
+        self->m_controller->flush([self](bool success)
+        {
+            asio::post(self->m_socket.get_executor(), BindHandler(self->m_handlerMemory, [self, success]()
+            {
+                if (!success)
+                    self->writeFailed();
+                self->sendResponse();
+            }));
+        });
+    }));
 }
 
 void HttpServer::Connection::handleRequest()
 {
+    /*
+    *   Header and body have separate deadlines, so a client trickling either of them is cut off
+    *   without waiting for the whole request's time limit. Pipelined requests that were already
+    *   received stay in the buffer and are parsed on the next read without touching the socket.
+    */
+    setDeadline(Phase::Header, m_requests == 0 ? m_config->httpHeaderTimeout() : m_config->httpIdleTimeout());
+    resetMessages();
+    m_parser->body_limit(m_config->httpMaxBody());
+
     auto self = shared_from_this();
-    beast::http::async_read(m_socket, m_buffer, m_request, [self](beast::error_code error, std::size_t bytesTransferred)
+    beast::http::async_read_header(m_socket, m_buffer, *m_parser, BindHandler(m_handlerMemory, [self](beast::error_code error, std::size_t bytesTransferred)
     {
         boost::ignore_unused(bytesTransferred);
+        if (error == beast::http::error::body_limit)
+        {
+            // Declared body length over the limit fails the header already
+            ++self->m_requests;
+            self->reject(Rejection::BodyTooLarge);
+            self->sendResponse();
+            return;
+        }
         if (error)
+        {
+            self->m_timeout.cancel();
             return;
+        }
+        ++self->m_requests;
 
-        self->produceResponse();
-        self->sendResponse();
-    });
+        // Requests of an overloaded server are rejected as soon as their header is received, before their body is read
+        if (self->m_overloaded)
+        {
+            self->reject(Rejection::Overload);
+            self->sendResponse();
+            return;
+        }
+
+        if (self->m_parser->is_done())
+        {
+            self->dispatchRequest();
+            return;
+        }
+
+        self->setDeadline(Phase::Body, self->m_config->httpBodyTimeout());
+        beast::http::async_read(self->m_socket, self->m_buffer, *self->m_parser, BindHandler(self->m_handlerMemory, [self](beast::error_code error, std::size_t bytesTransferred)
+        {
+            boost::ignore_unused(bytesTransferred);
+            if (error == beast::http::error::body_limit)
+            {
+                // Chunked bodies have no declared length and are rejected once they outgrow the limit
+                self->reject(Rejection::BodyTooLarge);
+                self->sendResponse();
+                return;
+            }
+            if (error)
+            {
+                self->m_timeout.cancel();
+                return;
+            }
+
+            self->dispatchRequest();
+        }));
+    }));
 }
 
 void HttpServer::startAccepting()
 {
-    m_acceptor.async_accept(m_socket, [this](beast::error_code error)
+    /*
+    *   Peer endpoint is filled by the accept itself,
+    *   so client address is known without a remote_endpoint() call.
+    */
+    // Connection of a failed accept is kept for the next one
+    if (!m_accepting)
+    {
+        m_accepting = m_pool.take();
+        if (m_accepting)
+        {
+            m_statistics->connectionReused();
+        }
+        else
+        {
+            // Every connection gets its own strand once, it's kept while the connection is pooled
+            m_accepting = std::make_unique<Connection>(m_requestLog, m_config, m_controller, m_stateCache, m_events, m_control, m_scheduler, m_routes, m_statistics, m_controllerStrand, asio::make_strand(m_context));
+            m_statistics->connectionCreated();
+        }
+    }
+
+    m_acceptor.async_accept(m_accepting->socket(), m_peer, [this](beast::error_code error)
     {
         if (error)
         {
+            if (error == asio::error::operation_aborted)
+                return;
+
+            // Load is shed by refusing connections for a while, the server never stops accepting for good
+            m_statistics->rejected(Rejection::AcceptFailed);
             m_logger->error("Couldn't accept connection: \"{}\" ({})", error.message(), error.value());
+            m_acceptRetry.expires_after(AcceptRetryDelay);
+            m_acceptRetry.async_wait([this](beast::error_code error)
+            {
+                if (!error)
+                    startAccepting();
+            });
             return;
         }
 
-        std::make_shared<Connection>(m_logger, m_config, m_controller, m_socket)->handleRequest();
+        // Accepts are never concurrent, the next one is started only below
+        if (!m_accepted)
+        {
+            m_accepted = true;
+            m_logger->info("First connection was accepted {:.1f} ms after launch", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_launched).count());
+        }
+
+        // Connections over the limit are only kept until their request is rejected
+        bool overloaded = m_pool.open() > m_config->httpMaxConnections();
+        Connection::Start(std::move(m_accepting), m_peer.address(), m_pool, overloaded);
         startAccepting();
     });
 }
 
-HttpServer::HttpServer(Config::Pointer config, Controller::Pointer controller)
-    : m_logger(std::make_shared<spdlog::logger>(Utility::CreateLogger("http_server")))
+HttpServer::HttpServer(Config::Pointer config, Controller::Pointer controller, Listeners& listeners)
+    : m_logger(Utility::CreateSharedLogger("http_server"))
     , m_config(config)
+    , m_requestLog(std::make_shared<RequestLog>(config, m_logger))
     , m_controller(controller)
-    , m_context(1)
-    , m_acceptor(m_context, { asio::ip::make_address("0.0.0.0"), config->httpPort() })
-    , m_socket(m_context)
+    , m_stateCache(std::make_shared<StateCache>(controller))
+    , m_routes(Connection::CreateRoutes())
+    , m_statistics(std::make_shared<Statistics>(*m_routes))
+    , m_pool(config->httpConnectionPool())
+    , m_context(config->httpThreads())
+    , m_events(std::make_shared<RelayEvents>(config, controller, m_context))
+    , m_control(config->controlPort() ? std::make_shared<ControlServer>(config, controller, m_context, listeners) : nullptr)
+    , m_scheduler(std::make_shared<Scheduler>(config, controller, m_context))
+    , m_controllerStrand(asio::make_strand(m_context))
+    , m_acceptor(listeners.acceptor(m_context, config->httpPort()))
+    , m_acceptRetry(m_context)
+    , m_accepted(false)
 {}
 
-void HttpServer::start()
+HttpServer::~HttpServer()
+{
+    /*
+    *   Handlers still pending when the context is destroyed recycle their connections,
+    *   a closed pool destroys them right away while the context's services still exist.
+    */
+    m_context.stop();
+
+    // Completions of pending waits for drivers post to the context, they are all called once drivers are flushed
+    m_controller->flush();
+    m_pool.close();
+}
+
+void HttpServer::start(std::chrono::steady_clock::time_point launched)
 {
-    m_logger->info("Listening for connections on port {}", m_config->httpPort());
+    m_launched = launched;
+    m_logger->info(
+        "Accepting connections on port {} with {} threads, {:.1f} ms after launch",
+        m_config->httpPort(), m_config->httpThreads(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launched).count()
+    );
     startAccepting();
-    m_context.run();
+    if (m_control)
+        m_control->start();
+
+    std::mutex exceptionMutex;
+    std::exception_ptr exception;
+    auto run = [this, &exceptionMutex, &exception]()
+    {
+        try
+        {
+            m_context.run();
+        }
+        catch (...)
+        {
+            std::lock_guard lock(exceptionMutex);
+            if (!exception)
+                exception = std::current_exception();
+            m_context.stop();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int index = 1; index < m_config->httpThreads(); ++index)
+        workers.emplace_back(run);
+    run();
+
+    for (std::thread& worker : workers)
+        worker.join();
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+void HttpServer::stop()
+{
+    m_context.stop();
 }
 
 } // namespace kc
@@ -5,46 +5,213 @@ namespace kc {
 I2C::Device::Device(const std::string& port, uint8_t address)
     : m_port(port)
     , m_address(address)
-    , m_fd(wiringPiI2CSetupInterface(m_port.c_str(), m_address))
+{}
+
+void I2C::Device::send(const std::vector<uint8_t>& data)
 {
-    if (m_fd == -1)
+    send(data.data(), data.size());
+}
+
+std::vector<uint8_t> I2C::Device::receive(int length)
+{
+    std::vector<uint8_t> buffer(length);
+    receive(buffer.data(), buffer.size());
+    return buffer;
+}
+
+I2C::FileDevice::FileDevice(const std::string& port, uint8_t address)
+    : Device(port, address)
+    , m_fd(-1)
+{}
+
+I2C::FileDevice::~FileDevice()
+{
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+void I2C::FileDevice::send(const uint8_t* data, size_t length)
+{
+    ssize_t bytesTransferred = write(m_fd, data, length);
+    if (bytesTransferred == -1)
     {
         throw std::runtime_error(fmt::format(
-            "kc::I2C::Device::Device(): Couldn't initialize communication with I2C device [{:#x}] on port \"{}\": errno is {}",
+            "kc::I2C::FileDevice::send(): Couldn't send data to I2C device [{:#x}] on port \"{}\": errno is {}",
             m_address, m_port, errno
         ));
     }
-}
 
-I2C::Device::~Device()
-{
-    close(m_fd);
+    if (static_cast<size_t>(bytesTransferred) != length)
+    {
+        throw std::runtime_error(fmt::format(
+            "kc::I2C::FileDevice::send(): Couldn't send data to I2C device [{:#x}] on port \"{}\": {} of {} bytes were transferred",
+            m_address, m_port, bytesTransferred, length
+        ));
+    }
 }
 
-void I2C::Device::send(const std::vector<uint8_t>& data)
+void I2C::FileDevice::receive(uint8_t* data, size_t length)
 {
-    int bytesTransferred = write(m_fd, data.data(), data.size());
+    ssize_t bytesTransferred = read(m_fd, data, length);
     if (bytesTransferred == -1)
     {
         throw std::runtime_error(fmt::format(
-            "kc::I2C::Device::send(): Couldn't send data to I2C device [{:#x}] on port \"{}\": errno is {}",
+            "kc::I2C::FileDevice::receive(): Couldn't receive data from I2C device [{:#x}] on port \"{}\": errno is {}",
             m_address, m_port, errno
         ));
     }
+
+    if (static_cast<size_t>(bytesTransferred) != length)
+    {
+        throw std::runtime_error(fmt::format(
+            "kc::I2C::FileDevice::receive(): Couldn't receive data from I2C device [{:#x}] on port \"{}\": {} of {} bytes were transferred",
+            m_address, m_port, bytesTransferred, length
+        ));
+    }
 }
 
-std::vector<uint8_t> I2C::Device::receive(int length)
+I2C::WiringPiDevice::WiringPiDevice(const std::string& port, uint8_t address)
+    : FileDevice(port, address)
 {
-    std::vector<uint8_t> buffer(length);
-    int bytesTransferred = read(m_fd, buffer.data(), buffer.size());
-    if (bytesTransferred == -1)
+#ifdef LORAINE_WIRINGPI
+    m_fd = wiringPiI2CSetupInterface(m_port.c_str(), m_address);
+    if (m_fd == -1)
     {
         throw std::runtime_error(fmt::format(
-            "kc::I2C::Device::receive(): Couldn't receive data from I2C device [{:#x}] on port \"{}\": errno is {}",
+            "kc::I2C::WiringPiDevice::WiringPiDevice(): Couldn't initialize communication with I2C device [{:#x}] on port \"{}\": errno is {}",
             m_address, m_port, errno
         ));
     }
-    return buffer;
+#else
+    throw std::runtime_error(fmt::format(
+        "kc::I2C::WiringPiDevice::WiringPiDevice(): Couldn't initialize communication with I2C device [{:#x}] on port \"{}\": Loraine is built without WiringPi",
+        m_address, m_port
+    ));
+#endif
+}
+
+I2C::LinuxDevice::LinuxDevice(const std::string& port, uint8_t address)
+    : FileDevice(port, address)
+{
+    m_fd = open(m_port.c_str(), O_RDWR);
+    if (m_fd == -1)
+    {
+        throw std::runtime_error(fmt::format(
+            "kc::I2C::LinuxDevice::LinuxDevice(): Couldn't open I2C port \"{}\": errno is {}",
+            m_port, errno
+        ));
+    }
+
+    if (ioctl(m_fd, I2C_SLAVE, m_address) == -1)
+    {
+        int error = errno;
+        close(m_fd);
+        m_fd = -1;
+        throw std::runtime_error(fmt::format(
+            "kc::I2C::LinuxDevice::LinuxDevice(): Couldn't select I2C device [{:#x}] on port \"{}\": errno is {}",
+            m_address, m_port, error
+        ));
+    }
+}
+
+void I2C::SimulatedDevice::transaction(const char* function)
+{
+    if (m_simulation.latency.count() > 0)
+        std::this_thread::sleep_for(m_simulation.latency);
+
+    if (m_simulation.failureRate > 0)
+    {
+        thread_local std::mt19937 generator(std::random_device{}());
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(generator) < m_simulation.failureRate)
+        {
+            throw std::runtime_error(fmt::format(
+                "kc::I2C::SimulatedDevice::{}(): Simulated transaction failure with I2C device [{:#x}] on port \"{}\": errno is {}",
+                function, m_address, m_port, EIO
+            ));
+        }
+    }
+}
+
+I2C::SimulatedDevice::SimulatedDevice(const std::string& port, uint8_t address, const Simulation& simulation)
+    : Device(port, address)
+    , m_simulation(simulation)
+    , m_latch(1, 0xFF)
+{}
+
+void I2C::SimulatedDevice::send(const uint8_t* data, size_t length)
+{
+    transaction("send");
+    if (length != 0)
+    {
+        std::lock_guard lock(m_mutex);
+        m_latch.assign(data, data + length);
+    }
+}
+
+void I2C::SimulatedDevice::receive(uint8_t* data, size_t length)
+{
+    transaction("receive");
+    std::lock_guard lock(m_mutex);
+    if (m_simulation.driftRate > 0)
+    {
+        // A drifted output stays drifted until the device is written again, just like a glitched latch
+        thread_local std::mt19937 generator(std::random_device{}());
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(generator) < m_simulation.driftRate)
+            m_latch[generator() % m_latch.size()] ^= static_cast<uint8_t>(1 << (generator() % 8));
+    }
+
+    for (size_t index = 0; index < length; ++index)
+        data[index] = m_latch[index % m_latch.size()];
+}
+
+I2C::Backend I2C::ParseBackend(const std::string& name)
+{
+    for (Backend backend : { Backend::WiringPi, Backend::Linux, Backend::Simulated })
+    {
+        if (name == BackendName(backend))
+            return backend;
+    }
+
+    throw std::invalid_argument(fmt::format(
+        "kc::I2C::ParseBackend(): Backend is unknown [name: \"{}\"]",
+        name
+    ));
+}
+
+const char* I2C::BackendName(Backend backend)
+{
+    switch (backend)
+    {
+        case Backend::WiringPi:
+            return "wiringpi";
+        case Backend::Linux:
+            return "linux";
+        case Backend::Simulated:
+            return "simulated";
+    }
+
+    throw std::runtime_error(fmt::format(
+        "kc::I2C::BackendName(): Backend is unknown [backend: {}]",
+        static_cast<int>(backend)
+    ));
+}
+
+I2C::Device::Pointer I2C::Open(Backend backend, const std::string& port, uint8_t address, const Simulation& simulation)
+{
+    switch (backend)
+    {
+        case Backend::WiringPi:
+            return std::make_unique<WiringPiDevice>(port, address);
+        case Backend::Linux:
+            return std::make_unique<LinuxDevice>(port, address);
+        case Backend::Simulated:
+            return std::make_unique<SimulatedDevice>(port, address, simulation);
+    }
+
+    throw std::runtime_error(fmt::format(
+        "kc::I2C::Open(): Backend is unknown [backend: {}]",
+        static_cast<int>(backend)
+    ));
 }
 
 } // namespace kc
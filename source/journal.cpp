@@ -0,0 +1,241 @@
+#include "journal.hpp"
+
+namespace kc {
+
+uint32_t Journal::Checksum(const Record& record)
+{
+    // FNV-1a
+    uint8_t bytes[offsetof(Record, checksum)];
+    std::memcpy(bytes, &record, sizeof(bytes));
+    uint32_t hash = 2166136261u;
+    for (uint8_t byte : bytes)
+        hash = (hash ^ byte) * 16777619u;
+    return hash;
+}
+
+std::optional<Journal::State> Journal::replay()
+{
+    /*
+    *   Records of a change are applied only once its last record is read,
+    *   and replay stops at the first record that is corrupted, torn or older than the committed state.
+    *   Records past the committed state are then overwritten by appends.
+    */
+    std::optional<State> committed;
+    State pending = {};
+    bool inChange = false;
+    m_position = sizeof(Header);
+    for (size_t offset = sizeof(Header); offset + sizeof(Record) <= m_mapSize; offset += sizeof(Record))
+    {
+        Record record;
+        std::memcpy(&record, m_map + offset, sizeof(record));
+        if (record.checksum != Checksum(record) || record.word >= m_words)
+            break;
+
+        if (!inChange)
+        {
+            if (committed && record.version <= committed->version)
+                break;
+            pending = committed ? *committed : State{};
+            pending.version = record.version;
+            inChange = true;
+        }
+        else if (record.version != pending.version)
+        {
+            break;
+        }
+
+        pending.mask.setWord(record.word, record.bits);
+        if (record.flags & LastFlag)
+        {
+            committed = pending;
+            inChange = false;
+            m_position = offset + sizeof(Record);
+        }
+    }
+    return committed;
+}
+
+void Journal::write(Record record)
+{
+    record.reserved = 0;
+    record.checksum = Checksum(record);
+    std::memcpy(m_map + m_position, &record, sizeof(record));
+    m_position += sizeof(record);
+}
+
+bool Journal::compact(const State& state)
+{
+    /*
+    *   The new journal is fully written before it replaces the old one,
+    *   so a crash at any point leaves either the old or the new journal in place.
+    */
+    std::string temporary = m_path + ".tmp";
+    int fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        m_logger->error("Couldn't create journal file \"{}\": errno is {}", temporary, errno);
+        return false;
+    }
+
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(m_size)) == 0)
+        map = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        m_logger->error("Couldn't map journal file \"{}\": errno is {}", temporary, errno);
+        close(fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    if (m_map)
+        munmap(m_map, m_mapSize);
+    if (m_fd != -1)
+        close(m_fd);
+    m_fd = fd;
+    m_map = static_cast<uint8_t*>(map);
+    m_mapSize = m_size;
+
+    Header header = { { 'L', 'R', 'J', '1' }, Format, static_cast<uint32_t>(m_relays), 0 };
+    std::memcpy(m_map, &header, sizeof(header));
+    m_position = sizeof(Header);
+    for (size_t index = 0; index < m_words; ++index)
+    {
+        uint8_t flags = index + 1 == m_words ? LastFlag : 0;
+        write({ state.version, state.mask.word(index), static_cast<uint16_t>(index), flags, 0, 0 });
+    }
+
+    if (rename(temporary.c_str(), m_path.c_str()) == -1)
+    {
+        m_logger->error("Couldn't replace journal file \"{}\": errno is {}", m_path, errno);
+        return false;
+    }
+    m_counters.add(Compactions);
+    return true;
+}
+
+Journal::Journal(const std::string& path, size_t size, size_t relays)
+    : m_logger(Utility::CreateSharedLogger("journal"))
+    , m_path(path)
+    , m_size(size)
+    , m_relays(relays)
+    , m_words((relays + RelaySet::WordBits - 1) / RelaySet::WordBits)
+    , m_fd(-1)
+    , m_map(nullptr)
+    , m_mapSize(0)
+    , m_position(0)
+    , m_failed(false)
+    , m_counters(CountersCount)
+{
+    auto start = std::chrono::steady_clock::now();
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd == -1)
+    {
+        throw std::runtime_error(fmt::format(
+            "kc::Journal::Journal(): Couldn't open journal file \"{}\": errno is {}",
+            m_path, errno
+        ));
+    }
+
+    struct stat status = {};
+    if (fstat(m_fd, &status) == 0 && status.st_size > 0 && static_cast<size_t>(status.st_size) < sizeof(Header))
+        m_logger->warn("Journal file \"{}\" is not a journal, starting a new one", m_path);
+    else if (status.st_size > 0)
+    {
+        void* map = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (map != MAP_FAILED)
+        {
+            m_map = static_cast<uint8_t*>(map);
+            m_mapSize = status.st_size;
+
+            Header header;
+            std::memcpy(&header, m_map, sizeof(header));
+            if (std::memcmp(header.magic, "LRJ1", sizeof(header.magic)) != 0 || header.format != Format)
+                m_logger->warn("Journal file \"{}\" is not a journal, starting a new one", m_path);
+            else if (header.relays != m_relays)
+                m_logger->warn("Journal file \"{}\" records {} relays instead of {}, starting a new one", m_path, header.relays, m_relays);
+            else
+                m_restored = replay();
+        }
+    }
+
+    // A journal of another size or without a committed state is replaced by a compacted one
+    if (!m_restored || m_mapSize != m_size)
+    {
+        if (!compact(m_restored.value_or(State{})))
+        {
+            throw std::runtime_error(fmt::format(
+                "kc::Journal::Journal(): Couldn't create journal file \"{}\"",
+                m_path
+            ));
+        }
+    }
+
+    if (m_restored)
+    {
+        m_logger->info(
+            "Restored state version {} of {} enabled relays in {} us",
+            m_restored->version, m_restored->mask.count(),
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()
+        );
+    }
+}
+
+Journal::~Journal()
+{
+    if (m_map)
+        munmap(m_map, m_mapSize);
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+void Journal::append(uint64_t version, const RelaySet& previous, const RelaySet& next)
+{
+    if (m_failed)
+        return;
+
+    size_t changed = 0, last = 0;
+    for (size_t index = 0; index < m_words; ++index)
+    {
+        if (previous.word(index) != next.word(index))
+        {
+            ++changed;
+            last = index;
+        }
+    }
+    if (changed == 0)
+        return;
+
+    if (m_position + changed * sizeof(Record) > m_mapSize)
+    {
+        // Compacted journal holds only the new state, so it always has room for it
+        if (!compact({ version, next }))
+        {
+            m_logger->error("Journal is disabled until restart");
+            m_counters.add(Failures);
+            m_failed = true;
+        }
+        return;
+    }
+
+    for (size_t index = 0; index <= last; ++index)
+    {
+        if (previous.word(index) != next.word(index))
+            write({ version, next.word(index), static_cast<uint16_t>(index), index == last ? LastFlag : uint8_t(0), 0, 0 });
+    }
+    m_counters.add(Records, changed);
+}
+
+void Journal::writeMetrics(std::string& metrics) const
+{
+    Metrics::WriteHeader(metrics, "loraine_journal_records_total", "State journal records appended", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_journal_records_total {}\n", m_counters.value(Records));
+
+    Metrics::WriteHeader(metrics, "loraine_journal_compactions_total", "State journal compactions", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_journal_compactions_total {}\n", m_counters.value(Compactions));
+
+    Metrics::WriteHeader(metrics, "loraine_journal_failures_total", "State journal compactions that failed and disabled it", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_journal_failures_total {}\n", m_counters.value(Failures));
+}
+
+} // namespace kc
@@ -0,0 +1,184 @@
+#include "listeners.hpp"
+
+namespace kc {
+
+std::vector<Listeners::Listener> Listeners::Inherit()
+{
+    const char* pid = std::getenv("LISTEN_PID");
+    const char* fds = std::getenv("LISTEN_FDS");
+    if (!pid || !fds)
+        return {};
+
+    // Passed sockets are meant for this process only, processes it spawns mustn't take them for their own
+    bool passedHere = std::strtol(pid, nullptr, 10) == getpid();
+    int count = std::atoi(fds);
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    if (!passedHere || count <= 0)
+        return {};
+
+    std::vector<Listener> listeners;
+    for (int fd = ListenFdsStart; fd < ListenFdsStart + count; ++fd)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        // Sockets that can't be used are kept with zero port, so that they are reported and closed
+        Listener listener = { fd, 0, 0, 0 };
+        int type = 0, listening = 0;
+        socklen_t length = sizeof(type);
+        sockaddr_storage address = {};
+        socklen_t addressLength = sizeof(address);
+        if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &length) == 0 && getsockname(fd, reinterpret_cast<sockaddr*>(&address), &addressLength) == 0)
+        {
+            length = sizeof(listening);
+            if (type == SOCK_STREAM && (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) != 0 || !listening))
+                type = 0;
+
+            listener.type = type;
+            listener.family = address.ss_family;
+            if (address.ss_family == AF_INET)
+                listener.port = ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+            else if (address.ss_family == AF_INET6)
+                listener.port = ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+            if (type != SOCK_STREAM && type != SOCK_DGRAM)
+                listener.port = 0;
+        }
+        listeners.push_back(listener);
+    }
+    return listeners;
+}
+
+Listeners::Listener Listeners::Bind(int type, uint16_t port)
+{
+    const char* protocol = type == SOCK_STREAM ? "TCP" : "UDP";
+    int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        throw std::runtime_error(fmt::format(
+            "kc::Listeners::Bind(): Couldn't create {} socket: errno is {}",
+            protocol, errno
+        ));
+    }
+
+    int reuse = 1;
+    if (type == SOCK_STREAM)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || (type == SOCK_STREAM && listen(fd, Backlog) == -1))
+    {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error(fmt::format(
+            "kc::Listeners::Bind(): Couldn't bind {} port {}: errno is {}",
+            protocol, port, error
+        ));
+    }
+    return { fd, type, AF_INET, port };
+}
+
+Listeners::Listener Listeners::take(int type, uint16_t port)
+{
+    auto listener = std::find_if(m_listeners.begin(), m_listeners.end(), [type, port](const Listener& listener)
+    {
+        return listener.type == type && listener.port == port;
+    });
+    if (listener == m_listeners.end())
+        return Bind(type, port);
+
+    Listener taken = *listener;
+    m_listeners.erase(listener);
+    return taken;
+}
+
+Listeners::Listeners(const Config& config)
+    : m_listeners(Inherit())
+{
+    spdlog::logger logger = Utility::CreateLogger("listeners");
+    std::vector<std::pair<int, uint16_t>> required = { { SOCK_STREAM, config.httpPort() } };
+    if (config.controlPort())
+    {
+        required.push_back({ SOCK_STREAM, config.controlPort() });
+        required.push_back({ SOCK_DGRAM, config.controlPort() });
+    }
+
+    for (auto [type, port] : required)
+    {
+        const char* protocol = type == SOCK_STREAM ? "TCP" : "UDP";
+        auto listener = std::find_if(m_listeners.begin(), m_listeners.end(), [type, port](const Listener& listener)
+        {
+            return listener.type == type && listener.port == port;
+        });
+        if (listener != m_listeners.end())
+        {
+            logger.info("Using {} port {} socket passed by service manager", protocol, port);
+            continue;
+        }
+
+        try
+        {
+            m_listeners.push_back(Bind(type, port));
+        }
+        catch (...)
+        {
+            for (const Listener& listener : m_listeners)
+                close(listener.fd);
+            throw;
+        }
+    }
+
+    // Passed sockets no configured port needs would never be served, clients are better off being refused
+    for (auto listener = m_listeners.begin(); listener != m_listeners.end();)
+    {
+        bool needed = std::find(required.begin(), required.end(), std::pair<int, uint16_t>(listener->type, listener->port)) != required.end();
+        if (needed)
+        {
+            ++listener;
+            continue;
+        }
+
+        logger.warn("Socket [fd: {}, port: {}] passed by service manager doesn't match any configured port, closing it", listener->fd, listener->port);
+        close(listener->fd);
+        listener = m_listeners.erase(listener);
+    }
+}
+
+Listeners::~Listeners()
+{
+    for (const Listener& listener : m_listeners)
+        close(listener.fd);
+}
+
+boost::asio::ip::tcp::acceptor Listeners::acceptor(boost::asio::io_context& context, uint16_t port)
+{
+    Listener listener = take(SOCK_STREAM, port);
+    try
+    {
+        return { context, listener.family == AF_INET6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4(), listener.fd };
+    }
+    catch (...)
+    {
+        close(listener.fd);
+        throw;
+    }
+}
+
+boost::asio::ip::udp::socket Listeners::datagramSocket(boost::asio::io_context& context, uint16_t port)
+{
+    Listener listener = take(SOCK_DGRAM, port);
+    try
+    {
+        return { context, listener.family == AF_INET6 ? boost::asio::ip::udp::v6() : boost::asio::ip::udp::v4(), listener.fd };
+    }
+    catch (...)
+    {
+        close(listener.fd);
+        throw;
+    }
+}
+
+} // namespace kc
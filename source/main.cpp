@@ -1,10 +1,14 @@
 // STL modules
 #include <filesystem>
+#include <future>
+#include <chrono>
 
 // Custom modules
 #include "config.hpp"
+#include "config_watcher.hpp"
 #include "controller.hpp"
 #include "http_server.hpp"
+#include "listeners.hpp"
 #include "utility.hpp"
 using namespace kc;
 
@@ -150,6 +154,7 @@ static Config::Pointer Init(const ParseResult& result)
 
 int main(int argc, char** argv)
 {
+    auto launched = std::chrono::steady_clock::now();
     ParseResult result = ParseOptions(argc, argv);
     switch (result.result)
     {
@@ -166,6 +171,7 @@ int main(int argc, char** argv)
     Config::Pointer config = Init(result);
     if (!config)
         return 1;
+    Utility::SetLogLevel(config->logLevel());
 
     fmt::print(
         "Welcome to Loraine\n"
@@ -175,11 +181,22 @@ int main(int argc, char** argv)
     spdlog::logger logger = Utility::CreateLogger("main");
     try
     {
-        Controller::Pointer controller = std::make_shared<Controller>(config);
-        HttpServer server(config, controller);
+        /*
+        *   I2C devices are opened and switched to their initial state while listening sockets are brought up.
+        *   Clients connecting in the meantime are queued by the kernel and served as soon as the server starts.
+        */
+        std::future<Controller::Pointer> controllerReady = std::async(std::launch::async, [config]()
+        {
+            return std::make_shared<Controller>(config);
+        });
+        Listeners listeners(*config);
+        Controller::Pointer controller = controllerReady.get();
+
+        HttpServer server(config, controller, listeners);
+        ConfigWatcher watcher(config);
 
         logger.info("Ready");
-        server.start();
+        server.start(launched);
     }
     catch (const std::exception& error)
     {
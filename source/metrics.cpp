@@ -0,0 +1,80 @@
+#include "metrics.hpp"
+
+namespace kc {
+
+Metrics::CounterSet::Line::Line()
+{
+    for (std::atomic<uint64_t>& value : values)
+        value.store(0, std::memory_order_relaxed);
+}
+
+size_t Metrics::CounterSet::Shard()
+{
+    static std::atomic<size_t> nextShard = 0;
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % Shards;
+    return shard;
+}
+
+Metrics::CounterSet::CounterSet(size_t size)
+    : m_size(size)
+    , m_lines((size + 7) / 8)
+    , m_shards(Shards * m_lines)
+{}
+
+uint64_t Metrics::CounterSet::value(size_t index) const
+{
+    uint64_t value = 0;
+    for (size_t shard = 0; shard < Shards; ++shard)
+        value += m_shards[shard * m_lines + index / 8].values[index % 8].load(std::memory_order_relaxed);
+    return value;
+}
+
+Metrics::HistogramSet::HistogramSet(size_t size)
+    : m_counters(size * Stride)
+{}
+
+void Metrics::HistogramSet::observe(size_t index, std::chrono::nanoseconds duration)
+{
+    uint64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    size_t bucket = 0;
+    while (bucket < std::size(Buckets) && microseconds > Buckets[bucket])
+        ++bucket;
+
+    m_counters.add(index * Stride + bucket);
+    m_counters.add(index * Stride + BucketsCount, microseconds);
+}
+
+void Metrics::HistogramSet::write(std::string& metrics, const char* name, const char* help, const char* label, const std::vector<std::string>& values) const
+{
+    WriteHeader(metrics, name, help, "histogram");
+    for (size_t index = 0, count = size(); index < count; ++index)
+    {
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < BucketsCount; ++bucket)
+        {
+            cumulative += m_counters.value(index * Stride + bucket);
+            if (bucket < std::size(Buckets))
+            {
+                fmt::format_to(std::back_inserter(metrics), "{}_bucket{{{}=\"{}\",le=\"{}\"}} {}\n",
+                    name, label, values[index], Buckets[bucket] / 1e6, cumulative);
+            }
+            else
+            {
+                fmt::format_to(std::back_inserter(metrics), "{}_bucket{{{}=\"{}\",le=\"+Inf\"}} {}\n",
+                    name, label, values[index], cumulative);
+            }
+        }
+
+        fmt::format_to(std::back_inserter(metrics), "{}_sum{{{}=\"{}\"}} {}\n",
+            name, label, values[index], m_counters.value(index * Stride + BucketsCount) / 1e6);
+        fmt::format_to(std::back_inserter(metrics), "{}_count{{{}=\"{}\"}} {}\n",
+            name, label, values[index], cumulative);
+    }
+}
+
+void Metrics::WriteHeader(std::string& metrics, const char* name, const char* help, const char* type)
+{
+    fmt::format_to(std::back_inserter(metrics), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+} // namespace kc
@@ -0,0 +1,338 @@
+#include "output_stage.hpp"
+
+namespace kc {
+
+void OutputStage::run(Bus& bus)
+{
+    size_t front = 2;
+    bool taken = false;
+    while (true)
+    {
+        uint64_t shared = bus.shared.load(std::memory_order_acquire);
+        if ((shared >> SequenceShift) == 0)
+        {
+            if (shared & StopFlag)
+                return;
+
+            // Outputs are verified only between writes and only once there are states to verify them against
+            if (shared & VerifyFlag)
+            {
+                bus.shared.fetch_and(~VerifyFlag, std::memory_order_acq_rel);
+                if (taken)
+                    verify(bus, bus.states[front]);
+                continue;
+            }
+
+            bus.shared.wait(shared, std::memory_order_acquire);
+            continue;
+        }
+
+        if (m_window.count() > 0 && !(shared & StopFlag))
+        {
+            /*
+            *   Submissions made during the window replace the shared states,
+            *   so a burst of changes results in a single write per driver.
+            */
+            std::this_thread::sleep_for(m_window);
+        }
+
+        // The latest states are taken and the worker's previous buffer is left in their place, marked as already taken
+        shared = bus.shared.load(std::memory_order_relaxed);
+        while (!bus.shared.compare_exchange_weak(shared, (shared & (StopFlag | VerifyFlag)) | front, std::memory_order_acq_rel, std::memory_order_relaxed));
+        front = shared & IndexMask;
+        taken = true;
+        const std::vector<uint8_t>& states = bus.states[front];
+        bool force = shared & ForceFlag;
+
+        // Writes are skipped only for outputs whose states are known, that is last written or verified successfully
+        bool success = true;
+        for (size_t index : bus.outputs)
+        {
+            const Output& output = m_outputs[index];
+            const uint8_t* flushing = states.data() + output.busOffset;
+            const uint8_t* written = bus.written.data() + output.busOffset;
+            if (!force && output.valid && std::equal(flushing, flushing + output.width, written))
+                continue;
+            success = write(bus, index, states) && success;
+        }
+
+        bus.acked.store(((shared >> SequenceShift) << AckShift) | (success ? 0 : FailedFlag), std::memory_order_release);
+        complete(bus, shared >> SequenceShift, success);
+    }
+}
+
+bool OutputStage::write(Bus& bus, size_t index, const std::vector<uint8_t>& states)
+{
+    Output& output = m_outputs[index];
+    const uint8_t* flushing = states.data() + output.busOffset;
+    uint8_t* written = bus.written.data() + output.busOffset;
+
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        output.device->send(flushing, output.width);
+        std::copy(flushing, flushing + output.width, written);
+        output.valid = true;
+        m_writes.add(index * 2);
+    }
+    catch (const std::runtime_error& error)
+    {
+        m_logger->error(error.what());
+        output.valid = false;
+        m_writes.add(index * 2 + 1);
+    }
+    m_writeDurations.observe(index, std::chrono::steady_clock::now() - start);
+    return output.valid;
+}
+
+void OutputStage::complete(Bus& bus, uint64_t sequence, bool success)
+{
+    /*
+    *   Waiters register under the wait lock after reading acknowledgements, and outcomes are reported under it
+    *   after acknowledging, so a waiter either sees this write acknowledged or is registered in time to get its outcome.
+    */
+    std::lock_guard lock(m_waitMutex);
+    for (auto& [target, waiter] : bus.waiters)
+    {
+        if (target > sequence)
+            continue;
+
+        waiter->success = waiter->success && success;
+        if (--waiter->pending == 0)
+            waiter->completion(waiter->success);
+    }
+    std::erase_if(bus.waiters, [sequence](const auto& entry) { return entry.first <= sequence; });
+}
+
+void OutputStage::verify(Bus& bus, const std::vector<uint8_t>& states)
+{
+    for (size_t index : bus.outputs)
+    {
+        Output& output = m_outputs[index];
+        if (output.valid)
+        {
+            const uint8_t* written = bus.written.data() + output.busOffset;
+            uint8_t* readBack = bus.readBack.data() + output.busOffset;
+            try
+            {
+                output.device->receive(readBack, output.width);
+                if (std::equal(readBack, readBack + output.width, written))
+                {
+                    m_verifications.add(index * 3);
+                    continue;
+                }
+
+                m_logger->warn(
+                    "Outputs of I2C device [{:#x}] on port \"{}\" drifted from written states, rewriting them",
+                    output.device->address(), output.device->port()
+                );
+                m_verifications.add(index * 3 + 1);
+            }
+            catch (const std::runtime_error& error)
+            {
+                // Outputs that couldn't be read back are no longer known to be in written states
+                m_logger->error(error.what());
+                m_verifications.add(index * 3 + 2);
+            }
+        }
+
+        // Drifted outputs and outputs whose last write failed are rewritten without waiting for a state change
+        write(bus, index, states);
+    }
+}
+
+void OutputStage::runVerification()
+{
+    std::unique_lock lock(m_verifyMutex);
+    while (!m_verifyCondition.wait_for(lock, m_verifyInterval, [this]() { return m_verifyStop; }))
+    {
+        for (std::unique_ptr<Bus>& bus : m_buses)
+        {
+            bus->shared.fetch_or(VerifyFlag, std::memory_order_release);
+            bus->shared.notify_one();
+        }
+    }
+}
+
+OutputStage::OutputStage(std::vector<Driver> drivers, std::chrono::microseconds window, std::chrono::milliseconds verifyInterval)
+    : m_logger(Utility::CreateSharedLogger("output_stage"))
+    , m_window(window)
+    , m_writes(drivers.size() * 2)
+    , m_writeDurations(drivers.size())
+    , m_verifications(drivers.size() * 3)
+    , m_submitted(0)
+    , m_verifyInterval(verifyInterval)
+    , m_verifyStop(false)
+{
+    size_t offset = 0;
+    for (Driver& driver : drivers)
+    {
+        auto bus = std::find_if(m_buses.begin(), m_buses.end(), [&driver](const std::unique_ptr<Bus>& bus)
+        {
+            return bus->port == driver.device->port();
+        });
+        if (bus == m_buses.end())
+        {
+            m_buses.push_back(std::make_unique<Bus>());
+            m_buses.back()->port = driver.device->port();
+            bus = m_buses.end() - 1;
+        }
+
+        (*bus)->outputs.push_back(m_outputs.size());
+        m_outputs.push_back({ std::move(driver.device), offset, (*bus)->written.size(), driver.width, false });
+        (*bus)->written.resize((*bus)->written.size() + driver.width);
+        offset += driver.width;
+    }
+
+    // Buffers keep their size, so handing states over never allocates
+    for (std::unique_ptr<Bus>& bus : m_buses)
+    {
+        for (std::vector<uint8_t>& states : bus->states)
+            states.resize(bus->written.size());
+        bus->submitted.resize(bus->written.size());
+        bus->readBack.resize(bus->written.size());
+        bus->back = 0;
+        bus->shared.store(1, std::memory_order_relaxed);
+        bus->requested.store(0, std::memory_order_relaxed);
+        bus->acked.store(0, std::memory_order_relaxed);
+    }
+    for (std::unique_ptr<Bus>& bus : m_buses)
+        bus->thread = std::thread(&OutputStage::run, this, std::ref(*bus));
+    if (m_verifyInterval.count() > 0)
+        m_verifyThread = std::thread(&OutputStage::runVerification, this);
+}
+
+OutputStage::~OutputStage()
+{
+    if (m_verifyThread.joinable())
+    {
+        {
+            std::lock_guard lock(m_verifyMutex);
+            m_verifyStop = true;
+        }
+        m_verifyCondition.notify_one();
+        m_verifyThread.join();
+    }
+
+    for (std::unique_ptr<Bus>& bus : m_buses)
+    {
+        bus->shared.fetch_or(StopFlag, std::memory_order_release);
+        bus->shared.notify_one();
+        bus->thread.join();
+    }
+}
+
+uint64_t OutputStage::submit(const uint8_t* states, bool force)
+{
+    std::lock_guard lock(m_mutex);
+    uint64_t sequence = m_submitted.load(std::memory_order_relaxed) + 1;
+    for (std::unique_ptr<Bus>& bus : m_buses)
+    {
+        std::vector<uint8_t>& back = bus->states[bus->back];
+        for (size_t index : bus->outputs)
+        {
+            const Output& output = m_outputs[index];
+            std::copy(states + output.offset, states + output.offset + output.width, back.begin() + output.busOffset);
+        }
+
+        // Buses whose states didn't change aren't woken up, unless their last write failed and has to be retried
+        if (!force && back == bus->submitted && !(bus->acked.load(std::memory_order_acquire) & FailedFlag))
+            continue;
+        bus->submitted = back;
+
+        // Force flag of states the worker hasn't taken yet is carried over to the states replacing them
+        uint64_t shared = bus->shared.load(std::memory_order_relaxed), next;
+        do
+        {
+            bool pendingForce = (shared >> SequenceShift) != 0 && (shared & ForceFlag);
+            next = (sequence << SequenceShift) | (shared & (StopFlag | VerifyFlag)) | (force || pendingForce ? ForceFlag : 0) | bus->back;
+        } while (!bus->shared.compare_exchange_weak(shared, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+        bus->back = shared & IndexMask;
+        bus->requested.store(sequence, std::memory_order_release);
+        bus->shared.notify_one();
+    }
+
+    // Sequence is published only after every bus got its states, so waiting for it never misses a bus
+    m_submitted.store(sequence, std::memory_order_release);
+    return sequence;
+}
+
+uint64_t OutputStage::submitted()
+{
+    return m_submitted.load(std::memory_order_acquire);
+}
+
+void OutputStage::wait(uint64_t sequence, Completion completion)
+{
+    /*
+    *   A bus that got no states since an earlier submission is done once it wrote that submission.
+    *   A bus that got newer states is waited for until it writes them, which covers the requested ones too.
+    */
+    auto waiter = std::make_shared<Waiter>(Waiter{ 0, true, std::move(completion) });
+    std::lock_guard lock(m_waitMutex);
+    for (std::unique_ptr<Bus>& bus : m_buses)
+    {
+        uint64_t target = std::min(sequence, bus->requested.load(std::memory_order_acquire));
+        uint64_t acked = bus->acked.load(std::memory_order_acquire);
+        if ((acked >> AckShift) >= target)
+        {
+            waiter->success = waiter->success && !(acked & FailedFlag);
+            continue;
+        }
+
+        bus->waiters.push_back({ target, waiter });
+        ++waiter->pending;
+    }
+
+    if (waiter->pending == 0)
+        waiter->completion(waiter->success);
+}
+
+bool OutputStage::wait(uint64_t sequence)
+{
+    // Result is set and notified under the mutex, so this frame can't be left while the completion still uses it
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::optional<bool> result;
+    wait(sequence, [&mutex, &condition, &result](bool success)
+    {
+        std::lock_guard lock(mutex);
+        result = success;
+        condition.notify_one();
+    });
+
+    std::unique_lock lock(mutex);
+    condition.wait(lock, [&result]() { return result.has_value(); });
+    return *result;
+}
+
+void OutputStage::writeMetrics(std::string& metrics) const
+{
+    std::vector<std::string> devices;
+    for (const Output& output : m_outputs)
+        devices.push_back(fmt::format("{}:{:#04x}", output.device->port(), output.device->address()));
+
+    Metrics::WriteHeader(metrics, "loraine_i2c_writes_total", "Successful I2C writes", "counter");
+    for (size_t index = 0; index < devices.size(); ++index)
+        fmt::format_to(std::back_inserter(metrics), "loraine_i2c_writes_total{{device=\"{}\"}} {}\n", devices[index], m_writes.value(index * 2));
+
+    Metrics::WriteHeader(metrics, "loraine_i2c_write_errors_total", "Failed I2C writes", "counter");
+    for (size_t index = 0; index < devices.size(); ++index)
+        fmt::format_to(std::back_inserter(metrics), "loraine_i2c_write_errors_total{{device=\"{}\"}} {}\n", devices[index], m_writes.value(index * 2 + 1));
+
+    m_writeDurations.write(metrics, "loraine_i2c_write_duration_seconds", "I2C write duration", "device", devices);
+
+    Metrics::WriteHeader(metrics, "loraine_i2c_verifications_total", "Driver read-backs that matched written states", "counter");
+    for (size_t index = 0; index < devices.size(); ++index)
+        fmt::format_to(std::back_inserter(metrics), "loraine_i2c_verifications_total{{device=\"{}\"}} {}\n", devices[index], m_verifications.value(index * 3));
+
+    Metrics::WriteHeader(metrics, "loraine_i2c_drifts_total", "Driver read-backs that differed from written states", "counter");
+    for (size_t index = 0; index < devices.size(); ++index)
+        fmt::format_to(std::back_inserter(metrics), "loraine_i2c_drifts_total{{device=\"{}\"}} {}\n", devices[index], m_verifications.value(index * 3 + 1));
+
+    Metrics::WriteHeader(metrics, "loraine_i2c_read_errors_total", "Failed driver read-backs", "counter");
+    for (size_t index = 0; index < devices.size(); ++index)
+        fmt::format_to(std::back_inserter(metrics), "loraine_i2c_read_errors_total{{device=\"{}\"}} {}\n", devices[index], m_verifications.value(index * 3 + 2));
+}
+
+} // namespace kc
@@ -0,0 +1,221 @@
+#include "relay_events.hpp"
+
+namespace kc {
+
+void RelayEvents::Subscriber::receive()
+{
+    auto self = shared_from_this();
+    m_socket.async_read_some(asio::buffer(m_readBuffer), [self](boost::system::error_code error, std::size_t bytesTransferred)
+    {
+        boost::ignore_unused(bytesTransferred);
+        if (error)
+        {
+            self->close();
+            return;
+        }
+        self->receive();
+    });
+}
+
+void RelayEvents::Subscriber::heartbeat()
+{
+    auto self = shared_from_this();
+    m_heartbeat.expires_after(m_events->m_config->httpIdleTimeout());
+    m_heartbeat.async_wait([self](boost::system::error_code error)
+    {
+        if (error || !self->m_socket.is_open())
+            return;
+
+        // Comments are ignored by clients, but reveal connections that were closed without notice
+        if (!self->m_writing)
+        {
+            self->m_message = ":\n\n";
+            self->write();
+        }
+        self->heartbeat();
+    });
+}
+
+void RelayEvents::Subscriber::enqueue(Controller::Snapshot snapshot)
+{
+    uint64_t lastVersion = m_queue.empty() ? m_sent.version : m_queue.back().version;
+    if (snapshot.version <= lastVersion)
+        return;
+
+    /*
+    *   A subscriber that can't keep up only needs the latest state:
+    *   changes are sent as deltas against the last sent state, so dropped snapshots lose nothing.
+    */
+    if (m_queue.size() >= static_cast<size_t>(m_events->m_config->httpEventQueue()))
+    {
+        m_events->m_counters.add(Coalesced, m_queue.size());
+        m_queue.clear();
+    }
+    m_queue.push_back(snapshot);
+    send();
+}
+
+void RelayEvents::Subscriber::send()
+{
+    while (!m_writing && !m_queue.empty())
+    {
+        Controller::Snapshot snapshot = m_queue.front();
+        m_queue.pop_front();
+
+        Controller::Mask changed = m_sent.mask ^ snapshot.mask;
+        m_sent = snapshot;
+        if (changed.none())
+            continue;
+
+        m_message = fmt::format("id: {}\nevent: change\ndata: ", snapshot.version);
+        StateCache::Serialize(m_message, *m_events->m_controller, snapshot.mask, changed);
+        m_message.append("\n\n");
+        m_events->m_counters.add(Sent);
+        write();
+    }
+}
+
+void RelayEvents::Subscriber::write()
+{
+    m_writing = true;
+    auto self = shared_from_this();
+    asio::async_write(m_socket, asio::buffer(m_message), [self](boost::system::error_code error, std::size_t bytesTransferred)
+    {
+        boost::ignore_unused(bytesTransferred);
+        self->m_writing = false;
+        if (error)
+        {
+            self->close();
+            return;
+        }
+        self->send();
+    });
+}
+
+void RelayEvents::Subscriber::close()
+{
+    boost::system::error_code error;
+    m_socket.shutdown(Socket::shutdown_both, error);
+    m_socket.close(error);
+    m_heartbeat.cancel();
+    m_queue.clear();
+}
+
+RelayEvents::Subscriber::Subscriber(RelayEvents::Pointer events, Socket&& socket)
+    : m_events(events)
+    , m_socket(std::move(socket))
+    , m_heartbeat(m_socket.get_executor())
+    , m_sent({ 0, {} })
+    , m_writing(false)
+{
+    m_events->m_counters.add(Subscribed);
+}
+
+RelayEvents::Subscriber::~Subscriber()
+{
+    m_events->m_counters.add(Unsubscribed);
+}
+
+void RelayEvents::Subscriber::start(unsigned version, Controller::Snapshot snapshot)
+{
+    m_sent = snapshot;
+    m_message = fmt::format(
+        "HTTP/{}.{} 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "id: {}\nevent: relays\ndata: ",
+        version / 10, version % 10, snapshot.version
+    );
+    StateCache::Serialize(m_message, *m_events->m_controller, snapshot.mask, m_events->m_controller->allRelays());
+    m_message.append("\n\n");
+
+    write();
+    receive();
+    heartbeat();
+}
+
+void RelayEvents::Subscriber::push(Controller::Snapshot snapshot)
+{
+    auto self = shared_from_this();
+    asio::post(m_socket.get_executor(), [self, snapshot]()
+    {
+        if (self->m_socket.is_open())
+            self->enqueue(snapshot);
+    });
+}
+
+void RelayEvents::notify()
+{
+    if (m_pending.exchange(true, std::memory_order_acq_rel))
+        return;
+    asio::post(m_context, [this]() { dispatch(); });
+}
+
+void RelayEvents::dispatch()
+{
+    // Changes made after the flag is cleared post a new dispatch, so none of them is missed
+    m_pending.store(false, std::memory_order_release);
+
+    std::lock_guard lock(m_mutex);
+    Controller::Snapshot snapshot = m_controller->snapshot();
+    for (size_t index = 0; index < m_subscribers.size();)
+    {
+        std::shared_ptr<Subscriber> subscriber = m_subscribers[index].lock();
+        if (!subscriber)
+        {
+            m_subscribers[index] = std::move(m_subscribers.back());
+            m_subscribers.pop_back();
+            continue;
+        }
+
+        subscriber->push(snapshot);
+        ++index;
+    }
+}
+
+RelayEvents::RelayEvents(Config::Pointer config, Controller::Pointer controller, asio::io_context& context)
+    : m_config(config)
+    , m_controller(controller)
+    , m_context(context)
+    , m_pending(false)
+    , m_counters(CountersCount)
+{
+    m_controller->listen([this](const Controller::Snapshot&) { notify(); });
+}
+
+RelayEvents::~RelayEvents()
+{
+    m_controller->listen({});
+}
+
+void RelayEvents::subscribe(unsigned version, Socket&& socket)
+{
+    auto subscriber = std::make_shared<Subscriber>(shared_from_this(), std::move(socket));
+    {
+        std::lock_guard lock(m_mutex);
+        m_subscribers.push_back(subscriber);
+    }
+
+    /*
+    *   The snapshot is taken after registration: a change missing from it
+    *   is dispatched to the subscriber later and arrives as a delta.
+    */
+    subscriber->start(version, m_controller->snapshot());
+}
+
+void RelayEvents::writeMetrics(std::string& metrics) const
+{
+    Metrics::WriteHeader(metrics, "loraine_event_subscribers", "Open relay event streams", "gauge");
+    fmt::format_to(std::back_inserter(metrics), "loraine_event_subscribers {}\n",
+        static_cast<int64_t>(m_counters.value(Subscribed) - m_counters.value(Unsubscribed)));
+
+    Metrics::WriteHeader(metrics, "loraine_events_sent_total", "Relay state change events sent to subscribers", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_events_sent_total {}\n", m_counters.value(Sent));
+
+    Metrics::WriteHeader(metrics, "loraine_events_coalesced_total", "Relay state changes dropped from lagging subscriber queues", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_events_coalesced_total {}\n", m_counters.value(Coalesced));
+}
+
+} // namespace kc
@@ -0,0 +1,201 @@
+#include "request_log.hpp"
+
+namespace kc {
+
+void RequestLog::write(const Record& record)
+{
+    beast::string_view method = beast::http::to_string(record.method);
+    fmt::memory_buffer message;
+    fmt::format_to(
+        std::back_inserter(message),
+        "{} {}{} from {}: {} {}",
+        std::string_view(method.data(), method.size()),
+        std::string_view(record.target, record.targetLength),
+        record.targetTruncated ? "..." : "",
+        record.address.to_string(),
+        record.status,
+        record.message
+    );
+
+    m_logger->log(record.time, spdlog::source_loc{}, record.level, spdlog::string_view_t(message.data(), message.size()));
+    m_counters.add(Written);
+}
+
+bool RequestLog::push(const Record& record)
+{
+    /*
+    *   Bounded MPMC queue by Dmitry Vyukov: every slot's sequence tells
+    *   whether it is free for the producer at given position or filled for the consumer.
+    */
+    uint64_t position = m_head.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true)
+    {
+        slot = &m_slots[position & m_mask];
+        int64_t difference = static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire) - position);
+        if (difference == 0)
+        {
+            if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = m_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->record = record;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool RequestLog::pop(Record& record)
+{
+    Slot& slot = m_slots[m_tail & m_mask];
+    if (slot.sequence.load(std::memory_order_acquire) != m_tail + 1)
+        return false;
+
+    record = slot.record;
+    slot.sequence.store(m_tail + m_slots.size(), std::memory_order_release);
+    ++m_tail;
+    return true;
+}
+
+void RequestLog::wake()
+{
+    // Pairs with the fence in run(): either the thread sees the pushed record, or this sees it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed))
+    {
+        m_signal.fetch_add(1, std::memory_order_release);
+        m_signal.notify_one();
+    }
+}
+
+void RequestLog::run()
+{
+    Record record;
+    uint64_t reportedDrops = 0;
+    auto lastReport = std::chrono::steady_clock::time_point();
+    while (true)
+    {
+        uint32_t signal = m_signal.load(std::memory_order_acquire);
+        bool written = false;
+        while (pop(record))
+        {
+            write(record);
+            written = true;
+        }
+
+        // Drops are reported at most once a second, so that reports don't make the overflow worse
+        bool running = m_running.load(std::memory_order_acquire);
+        uint64_t drops = m_counters.value(Dropped);
+        auto now = std::chrono::steady_clock::now();
+        if (drops != reportedDrops && (now - lastReport >= std::chrono::seconds(1) || !running))
+        {
+            m_logger->warn("Request log queue is full: {} records were dropped", drops - reportedDrops);
+            reportedDrops = drops;
+            lastReport = now;
+        }
+
+        if (written)
+            continue;
+        if (!running)
+            break;
+
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_slots[m_tail & m_mask].sequence.load(std::memory_order_acquire) == m_tail + 1)
+        {
+            m_sleeping.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        m_signal.wait(signal, std::memory_order_acquire);
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+    m_logger->flush();
+}
+
+RequestLog::RequestLog(Config::Pointer config, Logger logger)
+    : m_logger(logger)
+    , m_async(config->logAsync())
+    , m_overflow(config->logOverflow())
+    , m_slots(m_async ? std::bit_ceil(static_cast<size_t>(config->logQueueSize())) : 0)
+    , m_mask(m_slots.empty() ? 0 : m_slots.size() - 1)
+    , m_head(0)
+    , m_tail(0)
+    , m_signal(0)
+    , m_sleeping(false)
+    , m_running(true)
+    , m_counters(CountersCount)
+{
+    if (!m_async)
+        return;
+
+    for (size_t index = 0; index < m_slots.size(); ++index)
+        m_slots[index].sequence.store(index, std::memory_order_relaxed);
+    m_thread = std::thread(&RequestLog::run, this);
+}
+
+RequestLog::~RequestLog()
+{
+    if (!m_async)
+        return;
+
+    m_running.store(false, std::memory_order_release);
+    m_signal.fetch_add(1, std::memory_order_release);
+    m_signal.notify_one();
+    m_thread.join();
+}
+
+void RequestLog::log(spdlog::level::level_enum level, beast::http::verb method, std::string_view target, unsigned status, const asio::ip::address& address, const char* message)
+{
+    if (!m_logger->should_log(level))
+        return;
+
+    Record record;
+    record.time = spdlog::log_clock::now();
+    record.level = level;
+    record.method = method;
+    record.status = status;
+    record.address = address;
+    record.message = message;
+    record.targetLength = std::min(target.size(), TargetCapacity);
+    record.targetTruncated = target.size() > TargetCapacity;
+    std::copy_n(target.data(), record.targetLength, record.target);
+
+    if (!m_async)
+    {
+        write(record);
+        return;
+    }
+
+    while (!push(record))
+    {
+        if (m_overflow == Config::LogOverflow::Drop)
+        {
+            m_counters.add(Dropped);
+            return;
+        }
+
+        wake();
+        std::this_thread::yield();
+    }
+    wake();
+}
+
+void RequestLog::writeMetrics(std::string& metrics) const
+{
+    Metrics::WriteHeader(metrics, "loraine_log_records_written_total", "Request log records written to sinks", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_log_records_written_total {}\n", m_counters.value(Written));
+
+    Metrics::WriteHeader(metrics, "loraine_log_records_dropped_total", "Request log records dropped because queue was full", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_log_records_dropped_total {}\n", m_counters.value(Dropped));
+}
+
+} // namespace kc
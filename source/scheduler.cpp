@@ -0,0 +1,194 @@
+#include "scheduler.hpp"
+
+namespace kc {
+
+void Scheduler::arm()
+{
+    std::lock_guard lock(m_mutex);
+
+    // Entries of cancelled jobs and outdated entries of recurring jobs are dropped once they reach the top
+    while (!m_heap.empty())
+    {
+        auto job = m_jobs.find(m_heap.front().id);
+        if (job != m_jobs.end() && job->second.deadline == m_heap.front().deadline)
+            break;
+
+        std::pop_heap(m_heap.begin(), m_heap.end());
+        m_heap.pop_back();
+    }
+
+    if (m_heap.empty())
+    {
+        if (m_armed)
+            m_timer.cancel();
+        m_armed.reset();
+        return;
+    }
+
+    Clock::time_point deadline = m_heap.front().deadline;
+    if (m_armed == deadline)
+        return;
+
+    // Rearming cancels the previous wait, whose handler then completes with an error and is ignored
+    m_armed = deadline;
+    m_timer.expires_at(deadline);
+    m_timer.async_wait([self = shared_from_this()](boost::system::error_code error)
+    {
+        if (!error)
+            self->expire();
+    });
+}
+
+void Scheduler::expire()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_armed.reset();
+        m_due.clear();
+
+        Clock::time_point now = Clock::now();
+        while (!m_heap.empty() && m_heap.front().deadline <= now)
+        {
+            Entry entry = m_heap.front();
+            std::pop_heap(m_heap.begin(), m_heap.end());
+            m_heap.pop_back();
+
+            auto jobEntry = m_jobs.find(entry.id);
+            if (jobEntry == m_jobs.end() || jobEntry->second.deadline != entry.deadline)
+                continue;
+
+            Job& job = jobEntry->second;
+            m_lateness.observe(job.interval.count() != 0, now - job.deadline);
+            ++job.runs;
+            m_due.push_back(job);
+            if (job.interval.count() == 0)
+            {
+                m_jobs.erase(jobEntry);
+                continue;
+            }
+
+            /*
+            *   Recurring jobs keep their phase instead of drifting by the lateness of every run.
+            *   Runs missed while the scheduler was stalled are skipped rather than replayed in a burst.
+            */
+            job.deadline += job.interval;
+            if (job.deadline <= now)
+                job.deadline += ((now - job.deadline) / job.interval + 1) * job.interval;
+            m_heap.push_back({ job.deadline, job.id });
+            std::push_heap(m_heap.begin(), m_heap.end());
+        }
+    }
+
+    // Controller is updated outside of the lock, so that jobs can be managed while relays are switched
+    for (const Job& job : m_due)
+        m_controller->update(job.mask, job.value);
+    m_counters.add(Runs, m_due.size());
+    arm();
+}
+
+Scheduler::Scheduler(Config::Pointer config, Controller::Pointer controller, asio::io_context& context)
+    : m_config(config)
+    , m_controller(controller)
+    , m_timer(asio::make_strand(context))
+    , m_nextId(1)
+    , m_counters(CountersCount)
+    , m_lateness(2)
+{}
+
+Scheduler::AddResult Scheduler::add(const Controller::Mask& mask, const Controller::Mask& value, Clock::time_point deadline, std::chrono::milliseconds interval, Job& job)
+{
+    // Bounded deadlines and intervals keep every deadline computed for a recurring job from overflowing
+    if (interval.count() != 0 && (interval < MinInterval || interval > MaxHorizon))
+    {
+        throw std::invalid_argument(fmt::format(
+            "kc::Scheduler::add(): Interval is out of range [interval: {} ms]",
+            interval.count()
+        ));
+    }
+
+    Clock::time_point now = Clock::now();
+    if (deadline > now + MaxHorizon || deadline < now - MaxHorizon)
+        throw std::invalid_argument("kc::Scheduler::add(): Deadline is too far from now");
+
+    bool earliest;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_jobs.size() >= static_cast<size_t>(m_config->scheduleMaxJobs()))
+            return AddResult::Full;
+
+        job = { m_nextId++, mask, value, deadline, interval, 0 };
+        m_jobs.emplace(job.id, job);
+
+        // Entries of cancelled jobs are dropped lazily, the heap is rebuilt before they outnumber pending jobs
+        if (m_heap.size() >= 2 * m_jobs.size() + 64)
+        {
+            m_heap.clear();
+            for (const auto& entry : m_jobs)
+                m_heap.push_back({ entry.second.deadline, entry.first });
+            std::make_heap(m_heap.begin(), m_heap.end());
+        }
+        else
+        {
+            m_heap.push_back({ deadline, job.id });
+            std::push_heap(m_heap.begin(), m_heap.end());
+        }
+        earliest = !m_armed || deadline < *m_armed;
+    }
+
+    if (earliest)
+        asio::post(m_timer.get_executor(), [self = shared_from_this()]() { self->arm(); });
+    return AddResult::Added;
+}
+
+std::optional<Scheduler::Job> Scheduler::remove(uint64_t id)
+{
+    std::lock_guard lock(m_mutex);
+    auto jobEntry = m_jobs.find(id);
+    if (jobEntry == m_jobs.end())
+        return {};
+
+    Job job = jobEntry->second;
+    m_jobs.erase(jobEntry);
+    return job;
+}
+
+std::optional<Scheduler::Job> Scheduler::get(uint64_t id) const
+{
+    std::lock_guard lock(m_mutex);
+    auto jobEntry = m_jobs.find(id);
+    if (jobEntry == m_jobs.end())
+        return {};
+    return jobEntry->second;
+}
+
+std::vector<Scheduler::Job> Scheduler::jobs() const
+{
+    std::vector<Job> jobs;
+    {
+        std::lock_guard lock(m_mutex);
+        jobs.reserve(m_jobs.size());
+        for (const auto& entry : m_jobs)
+            jobs.push_back(entry.second);
+    }
+
+    std::sort(jobs.begin(), jobs.end(), [](const Job& left, const Job& right) { return left.id < right.id; });
+    return jobs;
+}
+
+void Scheduler::writeMetrics(std::string& metrics) const
+{
+    size_t pending;
+    {
+        std::lock_guard lock(m_mutex);
+        pending = m_jobs.size();
+    }
+    Metrics::WriteHeader(metrics, "loraine_schedules", "Pending scheduled jobs", "gauge");
+    fmt::format_to(std::back_inserter(metrics), "loraine_schedules {}\n", pending);
+
+    Metrics::WriteHeader(metrics, "loraine_schedule_runs_total", "Scheduled job runs", "counter");
+    fmt::format_to(std::back_inserter(metrics), "loraine_schedule_runs_total {}\n", m_counters.value(Runs));
+
+    m_lateness.write(metrics, "loraine_schedule_lateness_seconds", "Delay between scheduled and actual job run time", "kind", { "once", "recurring" });
+}
+
+} // namespace kc
@@ -0,0 +1,107 @@
+#include "state_cache.hpp"
+
+namespace kc {
+
+void StateCache::Serialize(std::string& body, const Controller& controller, const Controller::Mask& mask, const Controller::Mask& relays, bool pretty)
+{
+    /*
+    *   Output matches nlohmann::json dump() and dump(4) byte for byte,
+    *   but is appended straight to the body without building a JSON document.
+    */
+    if (relays.none())
+    {
+        body.append("{}");
+        return;
+    }
+
+    bool first = true;
+    auto append = [&body, &controller, &mask, pretty, &first](Controller::Relay relay)
+    {
+        const char* enabled = mask.test(relay) ? "true" : "false";
+        body.append(first ? "" : ",");
+        if (pretty)
+        {
+            body.append("\n    \"").append(controller.uniqueName(relay)).append("\": {\n        \"enabled\": ").append(enabled).append("\n    }");
+        }
+        else
+        {
+            body.append("\"").append(controller.uniqueName(relay)).append("\":{\"enabled\":").append(enabled).append("}");
+        }
+        first = false;
+    };
+
+    /*
+    *   All relays are serialized in the precomputed name order.
+    *   A few relays, like a single relay or a change event, are collected and sorted by their name ranks,
+    *   so that their serialization doesn't scan all the relays.
+    */
+    body.push_back('{');
+    if (relays == controller.allRelays())
+    {
+        for (Controller::Relay relay : controller.orderedRelays())
+            append(relay);
+    }
+    else
+    {
+        std::array<uint16_t, RelaySet::MaxRelays> selected;
+        size_t count = 0;
+        relays.forEach([&selected, &count](Controller::Relay relay) { selected[count++] = static_cast<uint16_t>(relay); });
+        std::sort(selected.begin(), selected.begin() + count, [&controller](uint16_t left, uint16_t right)
+        {
+            return controller.rank(left) < controller.rank(right);
+        });
+        for (size_t index = 0; index < count; ++index)
+            append(selected[index]);
+    }
+    body.append(pretty ? "\n}" : "}");
+}
+
+std::shared_ptr<const StateCache::Entry> StateCache::rebuild(uint64_t version)
+{
+    std::lock_guard lock(m_mutex);
+    std::shared_ptr<const Entry> entry = m_entry.load(std::memory_order_acquire);
+    if (entry && entry->version >= version)
+        return entry;
+
+    /*
+    *   The previously replaced entry is reused once no reader holds it anymore:
+    *   a retired entry can't be loaded again, so its use count only goes down.
+    *   Its strings keep their capacity, so steady state rebuilds don't allocate.
+    */
+    std::shared_ptr<Entry> next = std::move(m_retired);
+    if (next && next.use_count() == 1)
+        std::atomic_thread_fence(std::memory_order_acquire);
+    else
+        next = std::make_shared<Entry>();
+
+    /*
+    *   The snapshot may already be newer than requested version:
+    *   the entry is tagged with snapshot's own version, so it is never served as outdated.
+    */
+    Controller::Snapshot snapshot = m_controller->snapshot();
+    next->version = snapshot.version;
+    next->compact.clear();
+    Serialize(next->compact, *m_controller, snapshot.mask, m_controller->allRelays());
+    next->compact.push_back('\n');
+    next->pretty.clear();
+    Serialize(next->pretty, *m_controller, snapshot.mask, m_controller->allRelays(), true);
+    next->pretty.push_back('\n');
+
+    m_retired = std::const_pointer_cast<Entry>(m_entry.exchange(next, std::memory_order_acq_rel));
+    return next;
+}
+
+StateCache::StateCache(Controller::Pointer controller)
+    : m_controller(controller)
+{}
+
+void StateCache::relays(std::string& body, bool pretty)
+{
+    uint64_t version = m_controller->version();
+    std::shared_ptr<const Entry> entry = m_entry.load(std::memory_order_acquire);
+    if (!entry || entry->version < version)
+        entry = rebuild(version);
+    body.append(pretty ? entry->pretty : entry->compact);
+}
+
+} // namespace kc
@@ -2,6 +2,13 @@
 
 namespace kc {
 
+// Level of loggers created by Utility::CreateLogger()
+static spdlog::level::level_enum LogLevel = spdlog::level::info;
+
+// Shared loggers whose level is changed by Utility::SetLogLevel(), guarded by LoggersMutex along with LogLevel
+static std::vector<std::weak_ptr<spdlog::logger>> Loggers;
+static std::mutex LoggersMutex;
+
 spdlog::logger Utility::CreateLogger(const std::string& name, std::optional<bool> forceColor)
 {
     static auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
@@ -15,7 +22,31 @@ spdlog::logger Utility::CreateLogger(const std::string& name, std::optional<bool
         if (*forceColor)
             sink->set_color_mode(spdlog::color_mode::always);
     }
-    return { name, {sink} };
+
+    spdlog::logger logger(name, { sink });
+    std::lock_guard lock(LoggersMutex);
+    logger.set_level(LogLevel);
+    return logger;
+}
+
+std::shared_ptr<spdlog::logger> Utility::CreateSharedLogger(const std::string& name)
+{
+    auto logger = std::make_shared<spdlog::logger>(CreateLogger(name));
+    std::lock_guard lock(LoggersMutex);
+    std::erase_if(Loggers, [](const std::weak_ptr<spdlog::logger>& logger) { return logger.expired(); });
+    Loggers.push_back(logger);
+    return logger;
+}
+
+void Utility::SetLogLevel(spdlog::level::level_enum level)
+{
+    std::lock_guard lock(LoggersMutex);
+    LogLevel = level;
+    for (const std::weak_ptr<spdlog::logger>& weakLogger : Loggers)
+    {
+        if (std::shared_ptr<spdlog::logger> logger = weakLogger.lock())
+            logger->set_level(level);
+    }
 }
 
 } // namespace kc